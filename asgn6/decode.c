@@ -10,6 +10,7 @@
 #include "header.h"
 #include "io.h"
 #include "defines.h"
+#include "table.h"
 
 #define FLAG_FORMAT "   -%c %-12s %-s\n"
 
@@ -95,50 +96,54 @@ int main(int argc, char *argv[]) {
     Header h;
     read_bytes(infile, (uint8_t *) &h, sizeof(Header));
     // Validate magic number
-    if (h.magic != MAGIC) {
+    if (h.magic != MAGIC && h.magic != MAGIC_LENGTHS) {
         printf("Magic number does not match; this probably means the input was not encoded "
                "properly.\n");
         usage(argv[0]);
     }
     fchmod(outfile, h.permissions);
 
-    // Read encoded tree and rebuild it
-    uint8_t encoded_tree[h.tree_size];
+    // Read the code lengths or the encoded tree, and find the codes again
+    uint8_t encoded_tree[h.tree_size > 0 ? h.tree_size : 1];
     read_bytes(infile, encoded_tree, h.tree_size);
-    Node *root = rebuild_tree(h.tree_size, encoded_tree);
+    Code *codes = (Code *) calloc(ALPHABET, sizeof(Code));
+    if (h.magic == MAGIC_LENGTHS) {
+        uint8_t lengths[ALPHABET];
+        if (!rebuild_lengths(h.tree_size, encoded_tree, lengths)
+            || !build_canonical_codes(lengths, codes)) {
+            fprintf(stderr, "The code lengths are not valid.\n");
+            free(codes);
+            return 1;
+        }
+    } else {
+        // the tree is only needed for its codes, the table decodes whole codes at a time
+        Node *root = rebuild_tree(h.tree_size, encoded_tree);
+        build_codes(root, codes);
+        delete_tree(&root);
+    }
+    DecodeTable *table = table_create(codes);
+    free(codes);
+    if (table == NULL) {
+        fprintf(stderr, "Could not allocate the decoding table.\n");
+        return 1;
+    }
 
-    Node *cur = root;
     uint8_t buf[BLOCK];
     int buf_bytes = 0;
-    // for reading bit from infile
-    uint8_t bit;
     // add written and buffered when comparing
     while (bytes_written + buf_bytes < h.file_size) {
-        // leaf node
-        if (cur == NULL) {
-            cur = root;
-            continue;
-        }
-        if (cur->left == NULL && cur->right == NULL) {
-            buf[buf_bytes++] = cur->symbol;
-            // write if buffer is full
-            if (buf_bytes >= BLOCK) {
-                buf_bytes = 0;
-                write_bytes(outfile, buf, BLOCK);
-            }
-            // reset cur to top of tree
-            cur = root;
-            continue;
+        if (!table_decode(table, infile, &buf[buf_bytes])) {
+            fprintf(stderr, "The input ended before the whole file was decoded.\n");
+            break;
         }
-        read_bit(infile, &bit);
-        // go left for 0, right for 1
-        if (bit) {
-            cur = cur->right;
-        } else {
-            cur = cur->left;
+        // write if buffer is full
+        if (++buf_bytes >= BLOCK) {
+            buf_bytes = 0;
+            write_bytes(outfile, buf, BLOCK);
         }
     }
     write_bytes(outfile, buf, buf_bytes);
+    table_delete(&table);
 
     // Print stats if -v was specified
     if (verbose) {
@@ -148,6 +153,5 @@ int main(int argc, char *argv[]) {
     }
     close(infile);
     close(outfile);
-    delete_tree(&root);
     return 0;
 }
@@ -3,5 +3,7 @@
 #define BLOCK         4096 // 4KB blocks.
 #define ALPHABET      256 // ASCII + Extended ASCII.
 #define MAGIC         0xBEEFBBAD // 32-bit magic number.
+#define MAGIC_LENGTHS 0xBEEFBBAE // Magic number of files with canonical codes.
 #define MAX_CODE_SIZE (ALPHABET / 8) // Bytes for a maximum, 256-bit code.
 #define MAX_TREE_SIZE (3 * ALPHABET - 1) // Maximum Huffman tree dump size.
+#define MAX_CANONICAL 64 // Longest code canonical codes are used for.
@@ -177,20 +177,29 @@ int main(int argc, char *argv[]) {
     Code *table = (Code *) calloc(ALPHABET, sizeof(Code));
     build_codes(tree, table);
 
+    // only the lengths of the tree's codes are kept, the codes themselves are
+    // replaced by canonical ones of the same lengths, so the output is no larger
+    uint8_t lengths[ALPHABET];
+    bool canonical = make_canonical(table, lengths);
+
     // create header
     Header h;
-    h.magic = MAGIC;
+    h.magic = canonical ? MAGIC_LENGTHS : MAGIC;
     h.permissions = get_permissions(infile);
     fchmod(outfile, h.permissions); // equalize output file permissions
-    h.tree_size = tree_size(histogram);
+    h.tree_size = canonical ? lengths_size(lengths) : tree_size(histogram);
     h.file_size = get_size(infile);
 
     bytes_written = 0;
     // writes header to file
     write_bytes(outfile, (uint8_t *) &h, sizeof(h));
 
-    // puts tree in file
-    dump_tree(outfile, tree);
+    // puts the code lengths, or the tree, in file
+    if (canonical) {
+        dump_lengths(outfile, lengths);
+    } else {
+        dump_tree(outfile, tree);
+    }
 
     // writes each character's code to the file
     seek_to_start(infile);
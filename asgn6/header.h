@@ -5,6 +5,6 @@
 typedef struct {
     uint32_t magic;
     uint16_t permissions;
-    uint16_t tree_size;
+    uint16_t tree_size; // the size of the code lengths instead with MAGIC_LENGTHS
     uint64_t file_size;
 } Header;
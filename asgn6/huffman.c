@@ -132,6 +132,155 @@ Node *rebuild_tree(uint16_t nbytes, uint8_t tree[static nbytes]) {
     return root;
 }
 
+// Ways the code lengths can be stored, the first byte of the stored lengths.
+// Nibbles keep every length in 4 bits, so they take 128 bytes; runs keep a
+// (gap, length) pair of bytes for each symbol that has a code, where gap is the
+// number of symbols without one since the previous, so they suit few symbols
+// and are the only way to store lengths over 15.
+#define LENGTHS_NIBBLES 0
+#define LENGTHS_RUNS    1
+#define MAX_NIBBLE      15
+
+// Assigns canonical codes for the given code lengths: the codes of each
+// length are consecutive numbers in symbol order, and follow on from those
+// of the length before. Only the lengths need storing, since the codes
+// are found again with a counting sort of them.
+// Returns: false if the lengths are too long or could not be the lengths of a Huffman code
+//
+// lengths: the length of the code of every symbol, 0 if it has none
+// table: the array to fill with the created Codes
+bool build_canonical_codes(uint8_t lengths[static ALPHABET], Code table[static ALPHABET]) {
+    uint32_t count[MAX_CANONICAL + 1] = { 0 };
+    for (int i = 0; i < ALPHABET; i++) {
+        if (lengths[i] > MAX_CANONICAL) {
+            return false;
+        }
+        count[lengths[i]]++;
+    }
+    // every code of one length leaves two codes of the next length for the rest
+    uint64_t left = 1;
+    for (int length = 1; length <= MAX_CANONICAL; length++) {
+        left = 2 * left > ALPHABET ? ALPHABET + 1 : 2 * left; // more than any code can use up
+        if (count[length] > left) {
+            return false;
+        }
+        left -= count[length];
+    }
+    uint64_t next[MAX_CANONICAL + 1] = { 0 };
+    uint64_t code = 0;
+    for (int length = 1; length <= MAX_CANONICAL; length++) {
+        code = (code + (length > 1 ? count[length - 1] : 0)) << 1;
+        next[length] = code;
+    }
+    for (int i = 0; i < ALPHABET; i++) {
+        table[i] = code_init();
+        uint64_t value = next[lengths[i]]++;
+        // the most significant bit is written first, so longer codes sort after their prefixes
+        for (int b = lengths[i] - 1; b >= 0; b--) {
+            code_push_bit(&table[i], (value >> b) & 1);
+        }
+    }
+    return true;
+}
+
+// Replaces the codes with canonical codes of the same lengths, unless one
+// is longer than MAX_CANONICAL. Codes that long need terabytes of input,
+// and the tree is stored for them instead.
+// Returns: whether the codes were replaced
+//
+// table: the codes made by build_codes, left as they are if not replaced
+// lengths: the array to fill with the length of the code of every symbol
+bool make_canonical(Code table[static ALPHABET], uint8_t lengths[static ALPHABET]) {
+    for (int i = 0; i < ALPHABET; i++) {
+        if (code_size(&table[i]) > MAX_CANONICAL) {
+            return false;
+        }
+        lengths[i] = code_size(&table[i]);
+    }
+    // only fails before it changes the table
+    return build_canonical_codes(lengths, table);
+}
+
+// Calculates the byte size of the stored code lengths,
+// whichever way takes less room.
+// Returns: the size of the code lengths in bytes
+//
+// lengths: the length of the code of every symbol, 0 if it has none
+uint16_t lengths_size(uint8_t lengths[static ALPHABET]) {
+    uint16_t runs = 1, longest = 0;
+    for (int i = 0; i < ALPHABET; i++) {
+        runs += lengths[i] > 0 ? 2 : 0;
+        longest = lengths[i] > longest ? lengths[i] : longest;
+    }
+    uint16_t nibbles = 1 + ALPHABET / 2;
+    return longest > MAX_NIBBLE || runs < nibbles ? runs : nibbles;
+}
+
+// Writes the code lengths to the file,
+// in the way lengths_size chose.
+//
+// outfile: the file descriptor of the file to write to
+// lengths: the length of the code of every symbol, 0 if it has none
+void dump_lengths(int outfile, uint8_t lengths[static ALPHABET]) {
+    uint16_t size = lengths_size(lengths);
+    int bytes = 0;
+    if (size == 1 + ALPHABET / 2) {
+        buf[bytes++] = LENGTHS_NIBBLES;
+        for (int i = 0; i < ALPHABET; i += 2) {
+            buf[bytes++] = lengths[i] | lengths[i + 1] << 4;
+        }
+    } else {
+        buf[bytes++] = LENGTHS_RUNS;
+        int gap = 0;
+        for (int i = 0; i < ALPHABET; i++) {
+            if (lengths[i] == 0) {
+                gap++;
+                continue;
+            }
+            buf[bytes++] = gap;
+            buf[bytes++] = lengths[i];
+            gap = 0;
+        }
+    }
+    write_if_ready(outfile, buf, &bytes, true);
+    return;
+}
+
+// Reads the code lengths written by dump_lengths.
+// Returns: whether the bytes were valid code lengths
+//
+// nbytes: the size of the array/stored lengths
+// stored: the array of bytes to read from
+// lengths: the array to fill with the length of the code of every symbol
+bool rebuild_lengths(
+    uint16_t nbytes, uint8_t stored[static nbytes], uint8_t lengths[static ALPHABET]) {
+    for (int i = 0; i < ALPHABET; i++) {
+        lengths[i] = 0;
+    }
+    if (nbytes == 0) {
+        return false;
+    }
+    if (stored[0] == LENGTHS_NIBBLES && nbytes == 1 + ALPHABET / 2) {
+        for (int i = 0; i < ALPHABET; i += 2) {
+            lengths[i] = stored[1 + i / 2] & MAX_NIBBLE;
+            lengths[i + 1] = stored[1 + i / 2] >> 4;
+        }
+        return true;
+    }
+    if (stored[0] != LENGTHS_RUNS || nbytes % 2 == 0) {
+        return false;
+    }
+    int symbol = -1;
+    for (uint16_t i = 1; i < nbytes; i += 2) {
+        symbol += 1 + stored[i];
+        if (symbol >= ALPHABET || stored[i + 1] == 0) {
+            return false;
+        }
+        lengths[symbol] = stored[i + 1];
+    }
+    return true;
+}
+
 // Recursively deletes the given tree
 // using post traversal order.
 //
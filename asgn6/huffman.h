@@ -3,14 +3,26 @@
 #include "node.h"
 #include "code.h"
 #include "defines.h"
+#include <stdbool.h>
 #include <stdint.h>
 
 Node *build_tree(uint64_t hist[static ALPHABET]);
 
 void build_codes(Node *root, Code table[static ALPHABET]);
 
+bool build_canonical_codes(uint8_t lengths[static ALPHABET], Code table[static ALPHABET]);
+
+bool make_canonical(Code table[static ALPHABET], uint8_t lengths[static ALPHABET]);
+
 void dump_tree(int outfile, Node *root);
 
 Node *rebuild_tree(uint16_t nbytes, uint8_t tree[static nbytes]);
 
+uint16_t lengths_size(uint8_t lengths[static ALPHABET]);
+
+void dump_lengths(int outfile, uint8_t lengths[static ALPHABET]);
+
+bool rebuild_lengths(
+    uint16_t nbytes, uint8_t stored[static nbytes], uint8_t lengths[static ALPHABET]);
+
 void delete_tree(Node **root);
@@ -12,6 +12,10 @@ static uint8_t read_buf[BLOCK];
 static int read_current = 0;
 static int read_buffered = 0;
 
+// bits read ahead by peek_bits, the next one lowest
+static uint64_t bit_buf = 0;
+static uint32_t bit_count = 0;
+
 static uint8_t write_buf[BLOCK];
 static int write_buffered = 0;
 
@@ -71,6 +75,58 @@ bool read_bit(int infile, uint8_t *bit) {
     return true;
 }
 
+// Tops up the bit buffer a byte at a time from the
+// read buffer, until it holds more than 56 bits or
+// the file has run out.
+//
+// infile: the file descriptor of the file to read from
+static void refill_bits(int infile) {
+    while (bit_count <= 56) {
+        if (read_current == read_buffered) {
+            read_buffered = 8 * read_bytes(infile, read_buf, BLOCK);
+            read_current = 0;
+            if (read_buffered == 0) {
+                return;
+            }
+        }
+        bit_buf |= (uint64_t) read_buf[read_current / 8] << bit_count;
+        read_current += 8;
+        bit_count += 8;
+    }
+    return;
+}
+
+// Looks at the next bits of the file without
+// using them up, the first one lowest. Bits past
+// the end of the file read as 0. Not to be mixed
+// with read_bit, which does not see the bits
+// peek_bits has read ahead.
+// Returns: the bits
+//
+// infile: the file descriptor of the file to read from
+// n: the number of bits to look at, at most 32
+uint32_t peek_bits(int infile, uint32_t n) {
+    if (bit_count < n) {
+        refill_bits(infile);
+    }
+    return bit_buf & ((UINT64_C(1) << n) - 1);
+}
+
+// Uses up bits that were looked at with peek_bits.
+// Returns: whether there were that many bits left
+//
+// n: the number of bits to use up, at most 32
+bool skip_bits(uint32_t n) {
+    if (n > bit_count) {
+        bit_buf = 0;
+        bit_count = 0;
+        return false;
+    }
+    bit_buf >>= n;
+    bit_count -= n;
+    return true;
+}
+
 // Writes the given code to the specified outfile.
 //
 // outfile: the file descriptor of the file to write to
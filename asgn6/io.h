@@ -13,6 +13,10 @@ int write_bytes(int outfile, uint8_t *buf, int nbytes);
 
 bool read_bit(int infile, uint8_t *bit);
 
+uint32_t peek_bits(int infile, uint32_t n);
+
+bool skip_bits(uint32_t n);
+
 void write_code(int outfile, Code *c);
 
 void flush_codes(int outfile);
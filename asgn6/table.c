@@ -0,0 +1,185 @@
+#include "table.h"
+#include "io.h"
+
+#include <stdlib.h>
+
+// The number of bits the first lookup resolves.
+// Codes up to this long take a single lookup.
+#define TABLE_BITS 11
+
+// A slot of the table, for one pattern of the next bits.
+// A leaf gives the symbol and how many of the bits its code takes;
+// a link gives the subtable the bits after this level's are looked up in.
+typedef struct {
+    uint32_t value; // the symbol of a leaf, ALPHABET if no code fits, or the offset of a subtable
+    uint8_t length; // the bits this slot uses up
+    uint8_t next; // the number of bits the subtable is indexed by, 0 for a leaf
+} Entry;
+
+// The first table and all of its subtables, one after the other.
+struct DecodeTable {
+    uint32_t bits; // the number of bits the first table is indexed by
+    uint32_t size;
+    uint32_t capacity;
+    Entry *entries;
+};
+
+// Adds a subtable of empty slots to the end of the table.
+// Returns: the offset of the subtable, or UINT32_MAX on failure
+//
+// t: the table to grow
+// n: the number of slots to add
+static uint32_t add_slots(DecodeTable *t, uint32_t n) {
+    if (t->size + n > t->capacity) {
+        uint32_t capacity = 2 * t->capacity > t->size + n ? 2 * t->capacity : t->size + n;
+        Entry *entries = (Entry *) realloc(t->entries, capacity * sizeof(Entry));
+        if (entries == NULL) {
+            return UINT32_MAX;
+        }
+        t->entries = entries;
+        t->capacity = capacity;
+    }
+    for (uint32_t i = t->size; i < t->size + n; i++) {
+        t->entries[i] = (Entry) { .value = ALPHABET, .length = 0, .next = 0 };
+    }
+    t->size += n;
+    return t->size - n;
+}
+
+// Reads some bits of a Code as a number, the first one lowest,
+// the same order they are written to and peeked from the file in.
+// Returns: the bits
+//
+// c: a pointer to the Code
+// start: the index of the first bit
+// n: the number of bits, at most 32
+static uint32_t code_bits(Code *c, uint32_t start, uint32_t n) {
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        value |= (uint32_t) code_get_bit(c, start + i) << i;
+    }
+    return value;
+}
+
+// Returns whether two Codes start with the same bits.
+//
+// a: a pointer to the first Code
+// b: a pointer to the second Code
+// n: the number of bits to compare
+static bool same_prefix(Code *a, Code *b, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+        if (code_get_bit(a, i) != code_get_bit(b, i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Fills one level of the table with every code that continues the given prefix.
+// A code that ends within the level's bits fills every slot whose low bits are the
+// rest of the code; a longer one makes its slot a link, and the subtables of the
+// links are then filled the same way, each only as large as its longest code needs.
+// Returns: whether every subtable could be allocated
+//
+// t: the table
+// offset: the offset of the level's slots
+// bits: the number of bits the level is indexed by
+// depth: the number of bits of every code already used up before this level
+// prefix: a pointer to a Code starting with those bits, unused if depth is 0
+// codes: the code of every symbol, empty if the symbol has none
+static bool fill(
+    DecodeTable *t, uint32_t offset, uint32_t bits, uint32_t depth, Code *prefix, Code *codes) {
+    for (uint32_t s = 0; s < ALPHABET; s++) {
+        uint32_t length = code_size(&codes[s]);
+        if (length <= depth || (depth > 0 && !same_prefix(&codes[s], prefix, depth))) {
+            continue;
+        }
+        uint32_t rest = length - depth;
+        uint32_t index = code_bits(&codes[s], depth, rest < bits ? rest : bits);
+        if (rest <= bits) {
+            for (uint32_t j = index; j < (1u << bits); j += 1u << rest) {
+                t->entries[offset + j] = (Entry) { .value = s, .length = rest, .next = 0 };
+            }
+            continue;
+        }
+        // a link, next keeps the longest rest of a code through it until the subtable is made
+        Entry *e = &t->entries[offset + index];
+        if (e->next == 0) {
+            e->value = s;
+            e->length = bits;
+        }
+        e->next = rest - bits > e->next ? rest - bits : e->next;
+    }
+    for (uint32_t j = 0; j < (1u << bits); j++) {
+        Entry e = t->entries[offset + j];
+        if (e.next == 0) {
+            continue;
+        }
+        uint32_t sub_bits = e.next < TABLE_BITS ? e.next : TABLE_BITS;
+        uint32_t sub = add_slots(t, 1u << sub_bits); // may move the entries
+        if (sub == UINT32_MAX) {
+            return false;
+        }
+        t->entries[offset + j].value = sub;
+        t->entries[offset + j].next = sub_bits;
+        if (!fill(t, sub, sub_bits, depth + bits, &codes[e.value], codes)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Creates a table to decode the given codes with,
+// resolving up to TABLE_BITS bits per lookup.
+// Returns: a pointer to the table, or NULL on failure
+//
+// codes: the code of every symbol, as made by build_codes, empty if the symbol has none
+DecodeTable *table_create(Code codes[static ALPHABET]) {
+    DecodeTable *t = (DecodeTable *) calloc(1, sizeof(DecodeTable));
+    if (t == NULL) {
+        return NULL;
+    }
+    for (uint32_t s = 0; s < ALPHABET; s++) {
+        t->bits = code_size(&codes[s]) > t->bits ? code_size(&codes[s]) : t->bits;
+    }
+    t->bits = t->bits < TABLE_BITS ? t->bits : TABLE_BITS;
+    if (add_slots(t, 1u << t->bits) == UINT32_MAX || !fill(t, 0, t->bits, 0, NULL, codes)) {
+        table_delete(&t);
+        return NULL;
+    }
+    return t;
+}
+
+// Deletes the given table.
+//
+// t: a pointer to the address of the table
+void table_delete(DecodeTable **t) {
+    free((*t)->entries);
+    free(*t);
+    *t = NULL;
+    return;
+}
+
+// Decodes the next symbol from the file: one lookup with
+// the next bits resolves the symbol and the length of its
+// code, and only codes longer than TABLE_BITS go on to
+// a subtable.
+// Returns: whether a whole code was read
+//
+// t: the table to decode with
+// infile: the file descriptor of the file to read from
+// symbol: a pointer to the symbol to set
+bool table_decode(DecodeTable *t, int infile, uint8_t *symbol) {
+    Entry *e = &t->entries[peek_bits(infile, t->bits)];
+    while (e->next != 0) {
+        if (!skip_bits(e->length)) {
+            return false;
+        }
+        e = &t->entries[e->value + peek_bits(infile, e->next)];
+    }
+    if (e->value >= ALPHABET || !skip_bits(e->length)) {
+        return false;
+    }
+    *symbol = e->value;
+    return true;
+}
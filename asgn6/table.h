@@ -0,0 +1,14 @@
+#pragma once
+
+#include "code.h"
+#include "defines.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct DecodeTable DecodeTable;
+
+DecodeTable *table_create(Code codes[static ALPHABET]);
+
+void table_delete(DecodeTable **t);
+
+bool table_decode(DecodeTable *t, int infile, uint8_t *symbol);
@@ -3,9 +3,14 @@
 #include "code.h"
 #include "io.h"
 #include "stack.h"
+#include "huffman.h"
+#include "header.h"
+#include "table.h"
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 
 // Tests PriorityQueue functions and usability.
 void pq_test(void) {
@@ -93,10 +98,334 @@ void stack_test(void) {
     return;
 }
 
+// Picks symbols to encode: every symbol with a code once,
+// then the rest at random from them.
+//
+// codes: the code of every symbol, empty if the symbol has none
+// symbols: the array to fill
+// n: the number of symbols to pick, at least the number with a code
+static void pick_symbols(Code codes[static ALPHABET], uint8_t *symbols, int n) {
+    uint8_t present[ALPHABET];
+    int count = 0;
+    for (int i = 0; i < ALPHABET; i++) {
+        if (code_size(&codes[i]) > 0) {
+            present[count++] = i;
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        symbols[i] = i < count ? present[i] : present[random() % count];
+    }
+    return;
+}
+
+// Uses up the rest of the file, so the next one
+// is read with nothing read ahead.
+//
+// fd: the file descriptor of the file being decoded
+static void use_up(int fd) {
+    do {
+        peek_bits(fd, 32);
+    } while (skip_bits(32));
+    return;
+}
+
+// Writes symbols with the given codes to a temporary file,
+// and decodes them again with a DecodeTable.
+// Returns: whether every symbol was decoded
+//
+// codes: the code of every symbol, empty if the symbol has none
+// symbols: the symbols to write
+// n: the number of symbols
+static bool round_trip(Code codes[static ALPHABET], uint8_t *symbols, int n) {
+    FILE *file = tmpfile();
+    int fd = fileno(file);
+    for (int i = 0; i < n; i++) {
+        write_code(fd, &codes[symbols[i]]);
+    }
+    flush_codes(fd);
+    lseek(fd, 0, SEEK_SET);
+
+    DecodeTable *table = table_create(codes);
+    bool ok = table != NULL;
+    for (int i = 0; ok && i < n; i++) {
+        uint8_t symbol;
+        ok = table_decode(table, fd, &symbol) && symbol == symbols[i];
+    }
+    use_up(fd);
+    if (table != NULL) {
+        table_delete(&table);
+    }
+    fclose(file);
+    return ok;
+}
+
+// Returns: the length of the longest of the codes
+//
+// codes: the code of every symbol, empty if the symbol has none
+static uint32_t longest_code(Code codes[static ALPHABET]) {
+    uint32_t longest = 0;
+    for (int i = 0; i < ALPHABET; i++) {
+        longest = code_size(&codes[i]) > longest ? code_size(&codes[i]) : longest;
+    }
+    return longest;
+}
+
+// Finds the Huffman codes of a histogram, the same way encode does.
+//
+// hist: the array of byte occurrences
+// codes: the array to fill with the codes, empty if the symbol has none
+static void codes_for(uint64_t hist[static ALPHABET], Code codes[static ALPHABET]) {
+    for (int i = 0; i < ALPHABET; i++) {
+        codes[i] = code_init();
+    }
+    Node *root = build_tree(hist);
+    build_codes(root, codes);
+    delete_tree(&root);
+    return;
+}
+
+// Tests decoding with DecodeTable, with codes that take one
+// lookup, codes that go on to subtables, and a single symbol.
+void table_test(void) {
+    printf("Decode table test:\n");
+    Code codes[ALPHABET];
+    uint64_t hist[ALPHABET] = { 0 };
+    uint8_t symbols[10000];
+
+    // every byte about as common, so every code fits the first lookup
+    for (int i = 0; i < ALPHABET; i++) {
+        hist[i] = 100 + random() % 100;
+    }
+    codes_for(hist, codes);
+    pick_symbols(codes, symbols, 10000);
+    printf("Short codes (longest %u bits): %s\n", longest_code(codes),
+        round_trip(codes, symbols, 10000) ? "passed" : "FAILED");
+
+    // Fibonacci counts give codes one bit longer per symbol, far past one lookup
+    for (int i = 0; i < ALPHABET; i++) {
+        hist[i] = 0;
+    }
+    hist['a'] = hist['b'] = 1;
+    for (int i = 2; i < 40; i++) {
+        hist['a' + i] = hist['a' + i - 1] + hist['a' + i - 2];
+    }
+    codes_for(hist, codes);
+    pick_symbols(codes, symbols, 10000);
+    printf("Long codes (longest %u bits): %s\n", longest_code(codes),
+        round_trip(codes, symbols, 10000) ? "passed" : "FAILED");
+    uint8_t lengths[ALPHABET];
+    for (int i = 0; i < ALPHABET; i++) {
+        lengths[i] = code_size(&codes[i]);
+    }
+    bool ok = build_canonical_codes(lengths, codes) && round_trip(codes, symbols, 10000);
+    printf("Long canonical codes: %s\n", ok ? "passed" : "FAILED");
+
+    // a file of one repeated byte, with the two symbols encode always adds
+    uint8_t singles[] = { 'a', 0, 255 };
+    for (int s = 0; s < 3; s++) {
+        for (int i = 0; i < ALPHABET; i++) {
+            hist[i] = 0;
+        }
+        hist[singles[s]] = 1000;
+        hist[0]++;
+        hist[255]++;
+        codes_for(hist, codes);
+        for (int i = 0; i < 1000; i++) {
+            symbols[i] = singles[s];
+        }
+        printf("Single symbol %d: %s\n", singles[s],
+            round_trip(codes, symbols, 1000) ? "passed" : "FAILED");
+    }
+    return;
+}
+
+// Writes an encoded file the way encode does, with the code lengths
+// in the header, or the tree when a code is too long for them.
+// Returns: whether the code lengths were stored
+//
+// fd: the file descriptor of the file to write to
+// hist: the array of byte occurrences
+// symbols: the symbols to encode
+// n: the number of symbols
+// tree: whether to store the tree anyway, as files made before code lengths were
+static bool encode_file(
+    int fd, uint64_t hist[static ALPHABET], uint8_t *symbols, int n, bool tree) {
+    Code codes[ALPHABET];
+    codes_for(hist, codes);
+    uint8_t lengths[ALPHABET];
+    bool canonical = !tree && make_canonical(codes, lengths);
+    Header h = { .magic = canonical ? MAGIC_LENGTHS : MAGIC, .permissions = 0600 };
+    h.file_size = n;
+    h.tree_size = 0;
+    for (int i = 0; i < ALPHABET; i++) {
+        h.tree_size += hist[i] > 0 ? 3 : 0;
+    }
+    h.tree_size = canonical ? lengths_size(lengths) : h.tree_size - 1;
+    write_bytes(fd, (uint8_t *) &h, sizeof(h));
+    if (canonical) {
+        dump_lengths(fd, lengths);
+    } else {
+        Node *root = build_tree(hist);
+        dump_tree(fd, root);
+        delete_tree(&root);
+    }
+    for (int i = 0; i < n; i++) {
+        write_code(fd, &codes[symbols[i]]);
+    }
+    flush_codes(fd);
+    return canonical;
+}
+
+// Decodes a file the way decode does, from the code lengths
+// or the tree in its header, and compares it with the symbols.
+// Returns: whether the header was valid and every symbol was decoded
+//
+// fd: the file descriptor of the file to read from
+// symbols: the symbols the file should decode to
+// n: the number of symbols
+static bool decode_file(int fd, uint8_t *symbols, int n) {
+    Header h;
+    uint8_t stored[MAX_TREE_SIZE];
+    if (read_bytes(fd, (uint8_t *) &h, sizeof(h)) != sizeof(h) || h.file_size != (uint64_t) n
+        || h.tree_size > MAX_TREE_SIZE || read_bytes(fd, stored, h.tree_size) != h.tree_size) {
+        return false;
+    }
+    Code codes[ALPHABET];
+    for (int i = 0; i < ALPHABET; i++) {
+        codes[i] = code_init();
+    }
+    if (h.magic == MAGIC_LENGTHS) {
+        uint8_t lengths[ALPHABET];
+        if (!rebuild_lengths(h.tree_size, stored, lengths)
+            || !build_canonical_codes(lengths, codes)) {
+            return false;
+        }
+    } else if (h.magic == MAGIC) {
+        Node *root = rebuild_tree(h.tree_size, stored);
+        build_codes(root, codes);
+        delete_tree(&root);
+    } else {
+        return false;
+    }
+    DecodeTable *table = table_create(codes);
+    bool ok = table != NULL;
+    for (int i = 0; ok && i < n; i++) {
+        uint8_t symbol;
+        ok = table_decode(table, fd, &symbol) && symbol == symbols[i];
+    }
+    use_up(fd);
+    if (table != NULL) {
+        table_delete(&table);
+    }
+    return ok;
+}
+
+// Stores code lengths with dump_lengths and reads them back with rebuild_lengths.
+// Returns: whether they were stored in the expected number of bytes and form,
+// and read back the same
+//
+// lengths: the length of the code of every symbol, 0 if it has none
+// size: the number of bytes they should take
+// form: the first byte they should start with
+static bool lengths_round_trip(uint8_t lengths[static ALPHABET], uint16_t size, uint8_t form) {
+    FILE *file = tmpfile();
+    int fd = fileno(file);
+    dump_lengths(fd, lengths);
+    lseek(fd, 0, SEEK_SET);
+    uint8_t stored[2 * ALPHABET + 1];
+    uint8_t read_back[ALPHABET];
+    bool ok = lengths_size(lengths) == size && read_bytes(fd, stored, sizeof(stored)) == size
+              && stored[0] == form && rebuild_lengths(size, stored, read_back)
+              && memcmp(lengths, read_back, ALPHABET) == 0;
+    fclose(file);
+    return ok;
+}
+
+// Tests the headers: both ways of storing code lengths,
+// the tree stored instead when a code is too long for
+// canonical codes, and files made with the tree before.
+void header_test(void) {
+    printf("Header test:\n");
+    uint64_t hist[ALPHABET] = { 0 };
+    uint8_t lengths[ALPHABET];
+    uint8_t symbols[10000];
+    Code codes[ALPHABET];
+
+    // every byte has a code, so 4 bits each take less room than pairs of bytes
+    for (int i = 0; i < ALPHABET; i++) {
+        lengths[i] = 8;
+    }
+    printf("Nibble lengths: %s\n",
+        lengths_round_trip(lengths, 1 + ALPHABET / 2, 0) ? "passed" : "FAILED");
+
+    // a length over 15 does not fit a nibble, however many bytes have codes
+    lengths[0] = 16;
+    printf("Run lengths, long code: %s\n",
+        lengths_round_trip(lengths, 1 + 2 * ALPHABET, 1) ? "passed" : "FAILED");
+
+    // few bytes with codes take less room as pairs of bytes
+    for (int i = 0; i < ALPHABET; i++) {
+        lengths[i] = 0;
+    }
+    lengths[0] = lengths[255] = 2;
+    lengths['a'] = 1;
+    printf("Run lengths, few codes: %s\n",
+        lengths_round_trip(lengths, 7, 1) ? "passed" : "FAILED");
+    uint8_t bad[] = { 1, 255, 1, 0, 1 }; // a second symbol past the alphabet
+    printf("Bad lengths rejected: %s\n",
+        !rebuild_lengths(sizeof(bad), bad, lengths) ? "passed" : "FAILED");
+
+    // lengths 1, 2, ..., n, n fill a code exactly, so only their longest decides
+    for (int i = 0; i < ALPHABET; i++) {
+        lengths[i] = i < MAX_CANONICAL ? i + 1 : 0;
+    }
+    lengths[MAX_CANONICAL] = MAX_CANONICAL;
+    bool ok = build_canonical_codes(lengths, codes);
+    lengths[MAX_CANONICAL] = lengths[MAX_CANONICAL + 1] = MAX_CANONICAL + 1;
+    ok = ok && !build_canonical_codes(lengths, codes);
+    printf("Canonical codes up to %d bits: %s\n", MAX_CANONICAL, ok ? "passed" : "FAILED");
+
+    // Fibonacci counts of this many bytes give codes too long for canonical codes
+    hist[0] = hist[1] = 1;
+    for (int i = 2; i < MAX_CANONICAL + 3; i++) {
+        hist[i] = hist[i - 1] + hist[i - 2];
+    }
+    codes_for(hist, codes);
+    pick_symbols(codes, symbols, 10000);
+    FILE *file = tmpfile();
+    ok = !encode_file(fileno(file), hist, symbols, 10000, false)
+         && lseek(fileno(file), 0, SEEK_SET) == 0 && decode_file(fileno(file), symbols, 10000);
+    fclose(file);
+    printf("Tree header for %u bit codes: %s\n", longest_code(codes), ok ? "passed" : "FAILED");
+
+    // ordinary text, with code lengths and with the tree as before
+    char *text = "the quick brown fox jumps over the lazy dog";
+    for (int i = 0; i < ALPHABET; i++) {
+        hist[i] = 0;
+    }
+    int n = strlen(text);
+    for (int i = 0; i < n; i++) {
+        symbols[i] = text[i];
+        hist[symbols[i]]++;
+    }
+    hist[0]++;
+    hist[255]++;
+    for (int tree = 0; tree < 2; tree++) {
+        file = tmpfile();
+        ok = encode_file(fileno(file), hist, symbols, n, tree) == !tree
+             && lseek(fileno(file), 0, SEEK_SET) == 0 && decode_file(fileno(file), symbols, n);
+        fclose(file);
+        printf("%s header: %s\n", tree ? "Tree" : "Lengths", ok ? "passed" : "FAILED");
+    }
+    return;
+}
+
 int main(void) {
     pq_test();
     code_test();
     io_test();
     stack_test();
+    table_test();
+    header_test();
     return 0;
 }
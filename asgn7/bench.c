@@ -0,0 +1,836 @@
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#else
+#define HAVE_TSC 0
+#endif
+
+#include "bf.h"
+#include "bv.h"
+#include "cf.h"
+#include "ht.h"
+#include "metric.h"
+#include "parser.h"
+#include "pq.h"
+#include "prefetch.h"
+#include "salts.h"
+#include "speck.h"
+#include "stats.h"
+#include "text.h"
+
+// Counting allocations replaces malloc, which only works where the C library
+// lets a program do that and no sanitizer has already replaced it.
+#if defined(__SANITIZE_ADDRESS__)
+#define SANITIZED 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define SANITIZED 1
+#endif
+#endif
+#if defined(__GLIBC__) && !defined(SANITIZED)
+#define HAVE_ALLOC_COUNT 1
+#else
+#define HAVE_ALLOC_COUNT 0
+#endif
+
+#define FLAG_FORMAT "   -%c %-12s %-s\n"
+#define MAX_REPS    100
+#define SCORE_FILES 32 // the corpus is split into these many files for the scoring loop
+#define SCORE_DEPTH 4 // how far the scoring loop reads ahead, identify's default
+
+extern uint32_t hash_table_size, bloom_filter_size;
+
+// A synthetic corpus: a vocabulary of random words, and a stream of
+// words drawn from it with Zipf-distributed frequencies.
+typedef struct {
+    uint32_t vocab_size;
+    char **vocab;
+    uint32_t length;
+    char **words; // pointers into vocab
+    uint64_t bytes; // total length of the words in the stream
+    FILE *file; // the stream written out as text, for the parser and texts
+} Corpus;
+
+// Everything the benchmarks work on, set up before each timed run.
+static Corpus corpus, other;
+static HashTable *ht;
+static BloomFilter *bf;
+static CuckooFilter *cf; // the same number of bits as bf
+static BitVector *bv;
+static uint32_t *bits; // random bit indices for the bit vector benchmarks
+static Text *text1, *text2;
+static regex_t regex;
+static char *buffer; // the corpus file read into memory
+static size_t buffer_length;
+static volatile uint32_t sink; // keeps results alive so the work is not optimized away
+static Text *scratch; // kept across repetitions, like the scratch text of identify
+static Text *anon; // the other corpus, which the scoring loop scores against
+static char *score_paths[SCORE_FILES]; // the files of the scoring loop, written once
+static Prefetcher *pf;
+static PriorityQueue *pq;
+static uint64_t allocations; // calls to malloc, calloc and realloc so far
+
+#if HAVE_ALLOC_COUNT
+// glibc's own allocator, which the counting versions below hand every call to.
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+void *malloc(size_t size) {
+    __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+    __libc_free(ptr);
+}
+#endif
+
+// xorshift64*, so the corpus is the same for the same seed on every machine.
+// Returns: the next pseudorandom number.
+//
+// state: the generator state, must not be 0
+static uint64_t next_random(uint64_t *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545f4914f6cdd1d;
+}
+
+// Returns: a pseudorandom double in [0, 1).
+//
+// state: the generator state
+static double next_double(uint64_t *state) {
+    return (next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Builds a corpus of the given size.
+// Returns: whether the corpus could be built.
+//
+// c: the corpus to fill
+// vocab_size: the number of distinct words
+// length: the number of words in the stream
+// exponent: the Zipf exponent, 1 is roughly natural language
+// seed: the seed for the generator
+static bool corpus_create(
+    Corpus *c, uint32_t vocab_size, uint32_t length, double exponent, uint64_t seed) {
+    uint64_t state = seed ? seed : 1;
+    c->vocab_size = vocab_size;
+    c->length = length;
+    c->bytes = 0;
+    c->vocab = (char **) malloc(vocab_size * sizeof(char *));
+    c->words = (char **) malloc(length * sizeof(char *));
+    double *cdf = (double *) malloc(vocab_size * sizeof(double));
+    c->file = tmpfile();
+    if (c->vocab == NULL || c->words == NULL || cdf == NULL || c->file == NULL) {
+        free(cdf);
+        return false;
+    }
+    for (uint32_t i = 0; i < vocab_size; i++) {
+        // mostly short words, like English
+        uint32_t len = 2 + next_random(&state) % 5 + next_random(&state) % 6;
+        c->vocab[i] = (char *) malloc(len + 1);
+        for (uint32_t j = 0; j < len; j++) {
+            c->vocab[i][j] = 'a' + next_random(&state) % 26;
+        }
+        c->vocab[i][len] = '\0';
+    }
+    double total = 0;
+    for (uint32_t i = 0; i < vocab_size; i++) {
+        total += 1 / pow(i + 1, exponent);
+        cdf[i] = total;
+    }
+    for (uint32_t i = 0; i < length; i++) {
+        double u = next_double(&state) * total;
+        uint32_t lo = 0, hi = vocab_size - 1;
+        while (lo < hi) { // first rank whose cdf reaches u
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (cdf[mid] < u) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        c->words[i] = c->vocab[lo];
+        c->bytes += strlen(c->words[i]);
+        fprintf(c->file, "%s%s", c->words[i], i % 12 == 11 ? ".\n" : " ");
+    }
+    fflush(c->file);
+    free(cdf);
+    return true;
+}
+
+// Frees the given corpus.
+//
+// c: the corpus to free
+static void corpus_delete(Corpus *c) {
+    for (uint32_t i = 0; c->vocab != NULL && i < c->vocab_size; i++) {
+        free(c->vocab[i]);
+    }
+    free(c->vocab);
+    free(c->words);
+    if (c->file != NULL) {
+        fclose(c->file);
+    }
+    return;
+}
+
+// The setup, run and teardown steps of each benchmark below.
+// Run steps return the number of operations they performed.
+
+static void nothing(void) {
+    return;
+}
+
+static uint64_t run_hash(void) {
+    uint64_t salt[2] = { SALT_HASHTABLE_LO, SALT_HASHTABLE_HI };
+    for (uint32_t i = 0; i < corpus.length; i++) {
+        sink += hash(salt, corpus.words[i]);
+    }
+    return corpus.length;
+}
+
+static void make_table(void) {
+    ht = ht_create(hash_table_size);
+}
+
+static void fill_table(void) {
+    make_table();
+    for (uint32_t i = 0; i < corpus.length; i++) {
+        ht_insert(ht, corpus.words[i]);
+    }
+}
+
+static void free_table(void) {
+    ht_delete(&ht);
+}
+
+static uint64_t run_ht_insert(void) {
+    for (uint32_t i = 0; i < corpus.length; i++) {
+        sink += ht_insert(ht, corpus.words[i]) != NULL;
+    }
+    return corpus.length;
+}
+
+// Looks up the other corpus, so that both hits and misses are measured.
+static uint64_t run_ht_lookup(void) {
+    for (uint32_t i = 0; i < corpus.length; i++) {
+        sink += ht_lookup(ht, corpus.words[i]) != NULL;
+        sink += ht_lookup(ht, other.words[i]) != NULL;
+    }
+    return 2 * (uint64_t) corpus.length;
+}
+
+static void make_filter(void) {
+    bf = bf_create(bloom_filter_size);
+}
+
+static void fill_filter(void) {
+    make_filter();
+    for (uint32_t i = 0; i < corpus.length; i++) {
+        bf_insert(bf, corpus.words[i]);
+    }
+}
+
+static void free_filter(void) {
+    bf_delete(&bf);
+}
+
+static uint64_t run_bf_insert(void) {
+    for (uint32_t i = 0; i < corpus.length; i++) {
+        bf_insert(bf, corpus.words[i]);
+    }
+    return corpus.length;
+}
+
+static uint64_t run_bf_probe(void) {
+    for (uint32_t i = 0; i < corpus.length; i++) {
+        sink += bf_probe(bf, corpus.words[i]);
+        sink += bf_probe(bf, other.words[i]);
+    }
+    return 2 * (uint64_t) corpus.length;
+}
+
+static void make_cuckoo(void) {
+    cf = cf_create(bloom_filter_size / 16);
+}
+
+// Every distinct word once, since each insertion stores another copy.
+static void fill_cuckoo(void) {
+    make_cuckoo();
+    for (uint32_t i = 0; i < corpus.vocab_size; i++) {
+        cf_insert(cf, corpus.vocab[i]);
+    }
+}
+
+static void free_cuckoo(void) {
+    cf_delete(&cf);
+}
+
+static uint64_t run_cf_insert(void) {
+    for (uint32_t i = 0; i < corpus.vocab_size; i++) {
+        sink += cf_insert(cf, corpus.vocab[i]);
+    }
+    return corpus.vocab_size;
+}
+
+static uint64_t run_cf_probe(void) {
+    for (uint32_t i = 0; i < corpus.length; i++) {
+        sink += cf_probe(cf, corpus.words[i]);
+        sink += cf_probe(cf, other.words[i]);
+    }
+    return 2 * (uint64_t) corpus.length;
+}
+
+static uint64_t run_cf_remove(void) {
+    // every distinct word once, as each was inserted
+    for (uint32_t i = 0; i < corpus.vocab_size; i++) {
+        sink += cf_remove(cf, corpus.vocab[i]);
+    }
+    return corpus.vocab_size;
+}
+
+static void make_vector(void) {
+    bv = bv_create(bloom_filter_size);
+}
+
+static void free_vector(void) {
+    bv_delete(&bv);
+}
+
+static uint64_t run_bv_set(void) {
+    for (uint32_t i = 0; i < corpus.length; i++) {
+        bv_set_bit(bv, bits[i]);
+    }
+    return corpus.length;
+}
+
+static uint64_t run_bv_get(void) {
+    for (uint32_t i = 0; i < corpus.length; i++) {
+        sink += bv_get_bit(bv, bits[i]);
+    }
+    return corpus.length;
+}
+
+static uint64_t run_bv_clr(void) {
+    for (uint32_t i = 0; i < corpus.length; i++) {
+        bv_clr_bit(bv, bits[i]);
+    }
+    return corpus.length;
+}
+
+static void rewind_corpus(void) {
+    rewind(corpus.file);
+}
+
+static uint64_t run_next_word(void) {
+    uint64_t words = 0;
+    char *word;
+    while ((word = next_word(corpus.file, &regex)) != NULL) {
+        sink += word[0];
+        words++;
+    }
+    return words;
+}
+
+static void read_corpus(void) {
+    rewind(corpus.file);
+    fseek(corpus.file, 0, SEEK_END);
+    buffer_length = ftell(corpus.file);
+    rewind(corpus.file);
+    buffer = (char *) malloc(buffer_length + 1);
+    if (buffer == NULL || fread(buffer, 1, buffer_length, corpus.file) != buffer_length) {
+        buffer_length = 0;
+    }
+}
+
+static void free_buffer(void) {
+    free(buffer);
+    buffer = NULL;
+}
+
+static uint64_t run_scan_word(void) {
+    char word[MAX_WORD];
+    char *cursor = buffer;
+    uint64_t words = 0;
+    while (scan_word(&cursor, buffer + buffer_length, word) > 0) {
+        sink += word[0];
+        words++;
+    }
+    return words;
+}
+
+static void free_text(void) {
+    text_delete(&text1);
+}
+
+static uint64_t run_text_create(void) {
+    text1 = text_create(corpus.file, NULL);
+    return corpus.length;
+}
+
+static void make_scratch(void) {
+    read_corpus();
+    if (scratch == NULL) {
+        scratch = text_create_scratch();
+    }
+}
+
+// Counts the corpus into the scratch text the way identify counts every library text:
+// after the warm-up run has grown its blocks, this should not allocate at all.
+static uint64_t run_text_refill(void) {
+    text_reset(scratch);
+    text_fill_buffer(scratch, buffer, buffer_length, NULL);
+    return corpus.length;
+}
+
+static void make_texts(void) {
+    rewind(corpus.file);
+    rewind(other.file);
+    text1 = text_create(corpus.file, NULL);
+    text2 = text_create(other.file, NULL);
+}
+
+static void free_texts(void) {
+    text_delete(&text1);
+    text_delete(&text2);
+}
+
+static uint64_t run_text_dist(void) {
+    for (Metric m = EUCLIDEAN; m <= COSINE; m++) {
+        sink += text_dist(text1, text2, m) > 0;
+    }
+    return 3;
+}
+
+// Writes the corpus out as SCORE_FILES files of the same size, once.
+// Returns: whether the files could be written.
+static bool write_score_files(void) {
+    if (score_paths[0] != NULL) {
+        return true;
+    }
+    read_corpus();
+    size_t part = buffer_length / SCORE_FILES;
+    bool ok = buffer_length > 0;
+    for (uint32_t i = 0; ok && i < SCORE_FILES; i++) {
+        char path[] = "/tmp/bench-XXXXXX";
+        int fd = mkstemp(path);
+        ok = fd >= 0 && write(fd, buffer + i * part, part) == (ssize_t) part;
+        if (fd >= 0) {
+            close(fd);
+            score_paths[i] = strdup(path);
+        }
+    }
+    free_buffer();
+    return ok;
+}
+
+// Removes the files of the scoring loop.
+static void remove_score_files(void) {
+    for (uint32_t i = 0; i < SCORE_FILES && score_paths[i] != NULL; i++) {
+        unlink(score_paths[i]);
+        free(score_paths[i]);
+    }
+    return;
+}
+
+// Starts reading the files ahead and takes as many as the prefetcher has slots,
+// so each slot has grown to the size of a file before the loop is timed.
+static void make_score(void) {
+    if (!write_score_files()) {
+        fprintf(stderr, "Could not write the files of the scoring loop.\n");
+        exit(1);
+    }
+    if (scratch == NULL) {
+        scratch = text_create_scratch();
+    }
+    if (anon == NULL) {
+        rewind(other.file);
+        anon = text_create(other.file, NULL);
+    }
+    size_t length;
+    pf = pf_create(score_paths, SCORE_FILES, SCORE_DEPTH);
+    pq = pq_create(SCORE_FILES);
+    for (uint32_t i = 0; i <= SCORE_DEPTH; i++) {
+        sink += pf_take(pf, score_paths[i], &length) != NULL;
+    }
+}
+
+static void free_score(void) {
+    pf_delete(&pf);
+    pq_delete(&pq);
+}
+
+// Scores the rest of the files the way identify scores every library text: each is
+// taken from the prefetcher, counted into the scratch text, measured against the anonymous
+// text and queued. After the warm-up, the whole loop should not allocate at all.
+static uint64_t run_score_loop(void) {
+    for (uint32_t i = SCORE_DEPTH + 1; i < SCORE_FILES; i++) {
+        size_t length;
+        char *data = pf_take(pf, score_paths[i], &length);
+        text_fill_buffer(scratch, data, length, NULL);
+        enqueue(pq, NULL, text_dist(scratch, anon, COSINE));
+        text_reset(scratch);
+    }
+    return SCORE_FILES - SCORE_DEPTH - 1;
+}
+
+typedef struct {
+    char *name;
+    void (*setup)(void); // run before every repetition, not timed
+    uint64_t (*run)(void); // the timed part, returns the number of operations
+    void (*teardown)(void); // run after every repetition, not timed
+    bool per_byte; // whether the operations consume the corpus words
+} Bench;
+
+static Bench benches[] = {
+    { "hash", nothing, run_hash, nothing, true },
+    { "ht_insert", make_table, run_ht_insert, free_table, true },
+    { "ht_lookup", fill_table, run_ht_lookup, free_table, true },
+    { "bf_insert", make_filter, run_bf_insert, free_filter, true },
+    { "bf_probe", fill_filter, run_bf_probe, free_filter, true },
+    { "cf_insert", make_cuckoo, run_cf_insert, free_cuckoo, false },
+    { "cf_probe", fill_cuckoo, run_cf_probe, free_cuckoo, true },
+    { "cf_remove", fill_cuckoo, run_cf_remove, free_cuckoo, false },
+    { "bv_set_bit", make_vector, run_bv_set, free_vector, false },
+    { "bv_get_bit", make_vector, run_bv_get, free_vector, false },
+    { "bv_clr_bit", make_vector, run_bv_clr, free_vector, false },
+    { "next_word", rewind_corpus, run_next_word, nothing, true },
+    { "scan_word", read_corpus, run_scan_word, free_buffer, true },
+    { "text_create", rewind_corpus, run_text_create, free_text, true },
+    { "text_refill", make_scratch, run_text_refill, free_buffer, true },
+    { "text_dist", make_texts, run_text_dist, free_texts, false },
+    { "score_loop", make_score, run_score_loop, free_score, false },
+};
+
+#define BENCHES (sizeof(benches) / sizeof(benches[0]))
+
+// Reads the cycle counter, if there is one.
+// Returns: the current cycle count, or 0.
+static inline uint64_t cycles(void) {
+#if HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+// Runs one benchmark: a warm-up run, then the timed repetitions.
+// The median repetition is reported, so one noisy run does not skew it,
+// along with the most allocations any timed repetition made.
+//
+// b: the benchmark to run
+// reps: the number of timed repetitions
+static void run_bench(Bench *b, uint32_t reps) {
+    uint64_t ns[MAX_REPS], cyc[MAX_REPS], ops = 0, allocs = 0;
+    b->setup();
+    b->run(); // warm-up: faults in memory, fills caches and trains branch predictors
+    b->teardown();
+    for (uint32_t r = 0; r < reps; r++) {
+        b->setup();
+        uint64_t a0 = allocations;
+        uint64_t c0 = cycles(), t0 = stats_now();
+        ops = b->run();
+        uint64_t t1 = stats_now(), c1 = cycles();
+        allocs = allocations - a0 > allocs ? allocations - a0 : allocs;
+        b->teardown();
+        ns[r] = t1 - t0;
+        cyc[r] = c1 - c0;
+    }
+    qsort(ns, reps, sizeof(uint64_t), compare_u64);
+    qsort(cyc, reps, sizeof(uint64_t), compare_u64);
+    double median_ns = ns[reps / 2], median_cycles = cyc[reps / 2];
+    uint64_t bytes = b->per_byte ? corpus.bytes * (ops / corpus.length) : 0;
+    printf("%-12s %12.2f %14.0f", b->name, median_ns / ops, ops / (median_ns / 1e9));
+    if (HAVE_TSC && bytes > 0) {
+        printf(" %12.2f", median_cycles / bytes);
+    } else {
+        printf(" %12s", "-");
+    }
+    if (HAVE_ALLOC_COUNT) {
+        printf(" %12" PRIu64 "\n", allocs);
+    } else {
+        printf(" %12s\n", "-");
+    }
+    return;
+}
+
+// Every absent word is also probed with each of these many digits appended, since
+// the corpora only use letters: about ten probes per word of the other vocabulary,
+// so false positive rates near the cuckoo filter's 10^-4 are measured, not guessed.
+#define PROBE_SUFFIXES 10
+
+// The load a cuckoo filter is compared at, close to the most it reliably takes.
+#define CF_LOAD 0.95
+
+// Measures how often a filter claims to have a word the corpus does not have,
+// over the words of the other corpus that are not in the table and their variants.
+// Returns: the false positive rate.
+//
+// probe: probes the filter for a word
+// filter: the filter
+static double false_positives(bool (*probe)(void *, char *), void *filter) {
+    char word[64];
+    uint64_t hits = 0, absent = 0;
+    for (uint32_t i = 0; i < other.vocab_size; i++) {
+        if (ht_lookup(ht, other.vocab[i]) != NULL) { // short random words can be in both
+            continue;
+        }
+        for (uint32_t v = 0; v <= PROBE_SUFFIXES; v++) {
+            if (v == 0) {
+                snprintf(word, sizeof(word), "%s", other.vocab[i]);
+            } else {
+                snprintf(word, sizeof(word), "%s%" PRIu32, other.vocab[i], v - 1);
+            }
+            hits += probe(filter, word);
+            absent++;
+        }
+    }
+    return absent > 0 ? hits / (double) absent : 0;
+}
+
+static bool probe_bloom(void *filter, char *word) {
+    return bf_probe((BloomFilter *) filter, word);
+}
+
+static bool probe_cuckoo(void *filter, char *word) {
+    return cf_probe((CuckooFilter *) filter, word);
+}
+
+// Sizes a Bloom filter for a false positive rate, fills it and prints a row for it.
+// With k = 3 hashes and m bits for n words the rate is (1 - e^(-3n/m))^3.
+//
+// words: the words to store
+// n: the number of words
+// target: the false positive rate to size the filter for
+static void compare_bloom(char **words, uint32_t n, double target) {
+    double bits = -3.0 * n / log(1 - cbrt(target));
+    BloomFilter *f = bf_create(ceil(bits));
+    if (f == NULL) {
+        return;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        bf_insert(f, words[i]);
+    }
+    printf("%-12s %12.6f %12.2f %10s %12.6f\n", "bloom", target, bf_size(f) / (double) n, "-",
+        false_positives(probe_bloom, f));
+    bf_delete(&f);
+    return;
+}
+
+// Compares the space the two filters need for the same false positive rate.
+// The cuckoo filter keeps 16-bit fingerprints, so its rate is fixed by its load:
+// it gets the largest power of 2 buckets it can fill to CF_LOAD with the corpus'
+// distinct words, and that many words go in both kinds of filter. Bloom filters are
+// sized for 1% and 0.1%, then for the rate the cuckoo filter was measured at, so
+// the last two rows are the bits per word of each at an equal rate.
+static void compare_filters(void) {
+    fill_table();
+    uint32_t distinct = ht_count(ht); // not every word of the vocabulary is drawn
+    uint32_t slots = 4;
+    while (2.0 * slots * CF_LOAD <= distinct) {
+        slots *= 2;
+    }
+    uint32_t n = slots * CF_LOAD;
+    n = n < distinct ? n : distinct;
+    char **words = (char **) malloc((n > 0 ? n : 1) * sizeof(char *));
+    CuckooFilter *f = cf_create(slots);
+    if (words == NULL || f == NULL) {
+        free(words);
+        if (f != NULL) {
+            cf_delete(&f);
+        }
+        free_table();
+        return;
+    }
+    uint32_t slot = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        words[i] = ht_next(ht, &slot)->word;
+        cf_insert(f, words[i]);
+    }
+    double cf_rate = false_positives(probe_cuckoo, f);
+    printf("\n%" PRIu32 " distinct words, %" PRIu32 " stored\n", distinct, n);
+    printf("%-12s %12s %12s %10s %12s\n", "filter", "target fp", "bits/word", "load",
+        "false pos.");
+    compare_bloom(words, n, 0.01);
+    compare_bloom(words, n, 0.001);
+    printf("%-12s %12s %12.2f %10.3f %12.6f\n", "cuckoo", "-", cf_size(f) * 16.0 / n,
+        cf_count(f) / (double) cf_size(f), cf_rate);
+    // the expected rate of the cuckoo filter if no probe hit, so the Bloom filter stays finite
+    compare_bloom(words, n, cf_rate > 0 ? cf_rate : 2.0 * 4 * CF_LOAD / 65536);
+    printf("cf_* hash a word once with MurmurHash3 and bf_* three times with SPECK,\n"
+           "so most of the difference in their ns/op is the cost of hashing.\n");
+    cf_delete(&f);
+    free(words);
+    free_table();
+    return;
+}
+
+// Checks that removing words from a cuckoo filter never removes another word with
+// them: the corpus' distinct words fill a filter to CF_LOAD, where many share a
+// fingerprint and buckets with another, and every other one is removed again.
+// A word inserted twice must also still be there after one removal.
+// Returns: whether every word that was not removed is still found.
+static bool check_cuckoo_remove(void) {
+    fill_table();
+    uint32_t distinct = ht_count(ht);
+    uint32_t slots = 4;
+    while (2.0 * slots * CF_LOAD <= distinct) {
+        slots *= 2;
+    }
+    CuckooFilter *f = cf_create(slots);
+    if (f == NULL) {
+        free_table();
+        return false;
+    }
+    uint32_t n = slots * CF_LOAD < distinct ? slots * CF_LOAD : distinct;
+    uint32_t slot = 0, missing = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        cf_insert(f, ht_next(ht, &slot)->word);
+    }
+    slot = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        char *word = ht_next(ht, &slot)->word;
+        if (i % 2 == 1) {
+            cf_remove(f, word);
+        }
+    }
+    slot = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        char *word = ht_next(ht, &slot)->word;
+        missing += i % 2 == 0 && !cf_probe(f, word);
+    }
+    slot = 0;
+    char *twice = ht_next(ht, &slot)->word;
+    cf_insert(f, twice);
+    cf_remove(f, twice);
+    missing += !cf_probe(f, twice);
+    printf("\ncuckoo removal: %" PRIu32 " of %" PRIu32 " words removed, %" PRIu32
+           " false negatives\n",
+        n / 2, n, missing);
+    cf_delete(&f);
+    free_table();
+    return missing == 0;
+}
+
+// Shows program usage and exits the program.
+//
+// arg0: the command used to run the program
+static void usage(char *arg0) {
+    printf("SYNOPSIS\n");
+    printf("   Microbenchmarks for the author identification data structures.\n\n");
+
+    printf("USAGE\n");
+    printf("   %s [-n words] [-V vocabulary] [-s exponent] [-r reps] [-S seed] [-b name] [-H size] "
+           "[-B size] [-h]\n\n",
+        arg0);
+
+    printf("OPTIONS\n");
+    printf(FLAG_FORMAT, 'n', "words", "Sets the number of words in the corpus. (default: 1000000)");
+    printf(FLAG_FORMAT, 'V', "vocabulary", "Sets the number of distinct words. (default: 50000)");
+    printf(FLAG_FORMAT, 's', "exponent", "Sets the Zipf exponent of word ranks. (default: 1.0)");
+    printf(FLAG_FORMAT, 'r', "reps", "Sets the number of timed repetitions. (default: 5)");
+    printf(FLAG_FORMAT, 'S', "seed", "Sets the seed used to generate the corpus. (default: 1)");
+    printf(FLAG_FORMAT, 'b', "name", "Runs only the benchmarks whose name starts with this.");
+    printf(FLAG_FORMAT, 'H', "size", "Specifies the hash table size (default 1 << 19).");
+    printf(FLAG_FORMAT, 'B', "size", "Specifies the Bloom filter size (default 1 << 21).");
+    printf(FLAG_FORMAT, 'h', "", "Shows this message for program help and usage.");
+    exit(1);
+    return;
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t length = 1000000, vocab_size = 50000, reps = 5;
+    double exponent = 1.0;
+    uint64_t seed = 1;
+    char *only = "";
+
+    int option;
+    while ((option = getopt(argc, argv, "n:V:s:r:S:b:H:B:h")) != -1) {
+        switch (option) {
+        case 'n': length = strtoul(optarg, NULL, 10); break;
+        case 'V': vocab_size = strtoul(optarg, NULL, 10); break;
+        case 's': exponent = strtod(optarg, NULL); break;
+        case 'r': reps = strtoul(optarg, NULL, 10); break;
+        case 'S': seed = strtoull(optarg, NULL, 10); break;
+        case 'b': only = optarg; break;
+        case 'H': hash_table_size = strtoul(optarg, NULL, 10); break;
+        case 'B': bloom_filter_size = strtoul(optarg, NULL, 10); break;
+        case 'h':
+        default: usage(argv[0]); break;
+        }
+    }
+    if (length == 0 || vocab_size == 0 || reps == 0 || reps > MAX_REPS) {
+        usage(argv[0]);
+    }
+
+    // the second corpus has its own random vocabulary, for misses and distances
+    if (!corpus_create(&corpus, vocab_size, length, exponent, seed)
+        || !corpus_create(&other, vocab_size, length, exponent, ~seed)) {
+        fprintf(stderr, "Could not allocate the corpus.\n");
+        return 1;
+    }
+    bits = (uint32_t *) malloc(length * sizeof(uint32_t));
+    uint64_t state = seed ? seed : 1;
+    for (uint32_t i = 0; i < length; i++) {
+        bits[i] = next_random(&state) % bloom_filter_size;
+    }
+    if (regcomp(&regex, WORD_REGEX, REG_EXTENDED)) {
+        fprintf(stderr, "Regex could not compile.\n");
+        return 1;
+    }
+
+    printf("corpus: %" PRIu32 " words, %" PRIu32 " distinct, %" PRIu64
+           " bytes, zipf %.2f, seed %" PRIu64 "\n",
+        length, vocab_size, corpus.bytes, exponent, seed);
+    printf("%-12s %12s %14s %12s %12s\n", "benchmark", "ns/op", "ops/s", "cycles/byte",
+        "allocs/rep");
+    for (size_t i = 0; i < BENCHES; i++) {
+        if (strncmp(benches[i].name, only, strlen(only)) == 0) {
+            run_bench(&benches[i], reps);
+        }
+    }
+    bool ok = true;
+    if (strncmp("bf", only, strlen(only)) == 0 || strncmp("cf", only, strlen(only)) == 0) {
+        compare_filters();
+    }
+    if (strncmp("cf", only, strlen(only)) == 0) {
+        ok = check_cuckoo_remove();
+    }
+
+    regfree(&regex);
+    if (scratch != NULL) {
+        text_delete(&scratch);
+    }
+    if (anon != NULL) {
+        text_delete(&anon);
+    }
+    remove_score_files();
+    free(bits);
+    corpus_delete(&corpus);
+    corpus_delete(&other);
+    return ok ? 0 : 1;
+}
@@ -53,6 +53,21 @@ uint32_t bf_size(BloomFilter *bf) {
     return bv_length(bf->filter);
 }
 
+// Returns the number of bytes the Bloom filter takes.
+//
+// bf: the Bloom filter
+uint64_t bf_bytes(BloomFilter *bf) {
+    return sizeof(BloomFilter) + bv_bytes(bf->filter);
+}
+
+// Empties the Bloom filter, keeping its memory for the next set of words.
+//
+// bf: the Bloom filter
+void bf_clear(BloomFilter *bf) {
+    bv_clear(bf->filter);
+    return;
+}
+
 // A helper function to calculate the hashes
 // of a given word with the three salts in the bloom filter.
 //
@@ -13,6 +13,10 @@ void bf_delete(BloomFilter **bf);
 
 uint32_t bf_size(BloomFilter *bf);
 
+uint64_t bf_bytes(BloomFilter *bf);
+
+void bf_clear(BloomFilter *bf);
+
 void bf_insert(BloomFilter *bf, char *word);
 
 bool bf_probe(BloomFilter *bf, char *word);
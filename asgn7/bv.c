@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "bv.h"
 
@@ -44,6 +45,21 @@ uint32_t bv_length(BitVector *bv) {
     return bv->length;
 }
 
+// Clears every bit of the vector, keeping its memory.
+//
+// bv: the vector to clear
+void bv_clear(BitVector *bv) {
+    memset(bv->vector, 0, (bv->length + 7) / 8);
+    return;
+}
+
+// Returns the number of bytes the bit vector takes.
+//
+// bv: the vector
+uint64_t bv_bytes(BitVector *bv) {
+    return sizeof(BitVector) + (bv->length + 7) / 8;
+}
+
 // A helper function for readability.
 // Returns: whether or not the bit index is within the bounds of the vector.
 //
@@ -11,6 +11,10 @@ void bv_delete(BitVector **bv);
 
 uint32_t bv_length(BitVector *bv);
 
+uint64_t bv_bytes(BitVector *bv);
+
+void bv_clear(BitVector *bv);
+
 bool bv_set_bit(BitVector *bv, uint32_t i);
 
 bool bv_clr_bit(BitVector *bv, uint32_t i);
@@ -0,0 +1,192 @@
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "stats.h"
+
+#define MIN_SLOTS 64
+
+// A distance already computed for some contents during this run.
+typedef struct {
+    Digest key;
+    double dist;
+    bool used;
+} Entry;
+
+// Remembers texts by a digest of their contents, so that the same contents
+// are only ever tokenized once. Within a run the anonymous text and metric
+// are fixed, so a repeated text just reuses its distance. Across runs the
+// word counts of each text are kept as files in a directory.
+struct Cache {
+    char *dir; // NULL if there is no on-disk cache
+    uint64_t seed; // fingerprint of the noise, part of every key
+    uint32_t count;
+    uint32_t size; // power of 2
+    Entry *entries;
+};
+
+// Creates a cache.
+// Returns: a pointer to the cache, or NULL on failure.
+//
+// dir: the directory to keep texts in across runs, or NULL to only cache within the run
+// noise: the noise words texts are read with, since they change the counts
+Cache *cache_create(char *dir, NoiseSet *noise) {
+    Cache *c = (Cache *) malloc(sizeof(Cache));
+    if (c == NULL) {
+        return NULL;
+    }
+    c->dir = dir;
+    c->seed = ns_digest(noise);
+    c->count = 0;
+    c->size = MIN_SLOTS;
+    c->entries = (Entry *) calloc(c->size, sizeof(Entry));
+    if (c->entries == NULL) {
+        free(c);
+        return NULL;
+    }
+    return c;
+}
+
+// Deletes the cache. The files on disk are kept.
+//
+// c: a pointer to the address of the cache
+void cache_delete(Cache **c) {
+    free((*c)->entries);
+    free(*c);
+    *c = NULL;
+    return;
+}
+
+// Computes the key for some contents.
+// Returns: the key.
+//
+// c: the cache the key is for
+// data: the contents of the text
+// length: the number of bytes of contents
+Digest cache_key(Cache *c, char *data, size_t length) {
+    return digest(data, length, c->seed);
+}
+
+// Finds the slot for a key, either the one holding it or the first empty one.
+// Returns: a pointer to the slot.
+//
+// c: the cache to look in
+// key: the key to look for
+static Entry *find(Cache *c, Digest key) {
+    uint32_t i = key.lo & (c->size - 1);
+    while (c->entries[i].used && (c->entries[i].key.hi != key.hi || c->entries[i].key.lo != key.lo)) {
+        i = (i + 1) & (c->size - 1);
+    }
+    return &c->entries[i];
+}
+
+// Looks up the distance already computed for the contents.
+// Returns: whether there was one.
+//
+// c: the cache to look in
+// key: the key of the contents
+// dist: where to store the distance
+bool cache_find_dist(Cache *c, Digest key, double *dist) {
+    Entry *e = find(c, key);
+    if (!e->used) {
+        return false;
+    }
+    *dist = e->dist;
+    stats_count(CACHE_HITS, 1);
+    return true;
+}
+
+// Remembers the distance computed for the contents.
+//
+// c: the cache to add to
+// key: the key of the contents
+// dist: the distance
+void cache_add_dist(Cache *c, Digest key, double dist) {
+    if (2 * (c->count + 1) > c->size) { // grow to stay at most half full
+        Entry *old = c->entries;
+        uint32_t old_size = c->size;
+        Entry *entries = (Entry *) calloc(2 * old_size, sizeof(Entry));
+        if (entries == NULL) {
+            return; // it is only a cache
+        }
+        c->entries = entries;
+        c->size = 2 * old_size;
+        for (uint32_t i = 0; i < old_size; i++) {
+            if (old[i].used) {
+                *find(c, old[i].key) = old[i];
+            }
+        }
+        free(old);
+    }
+    Entry *e = find(c, key);
+    if (!e->used) {
+        c->count++;
+    }
+    *e = (Entry) { .key = key, .dist = dist, .used = true };
+    return;
+}
+
+// Builds the path of a key's file.
+//
+// c: the cache
+// key: the key
+// suffix: appended to the name
+// path: where to store the path
+// size: the size of path
+static void key_path(Cache *c, Digest key, char *suffix, char *path, size_t size) {
+    snprintf(path, size, "%s/%016" PRIx64 "%016" PRIx64 ".txt1%s", c->dir, key.hi, key.lo, suffix);
+    return;
+}
+
+// Reads the text with the given key from disk.
+// Returns: the text, or NULL if it is not cached.
+//
+// c: the cache to read from
+// key: the key of the contents
+Text *cache_read(Cache *c, Digest key) {
+    if (c->dir == NULL) {
+        return NULL;
+    }
+    char path[4096];
+    key_path(c, key, "", path, sizeof(path));
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+    Text *text = text_read(f);
+    fclose(f);
+    if (text != NULL) {
+        stats_count(CACHE_DISK_HITS, 1);
+    }
+    return text;
+}
+
+// Writes the text to disk under the given key. The file is written under
+// a temporary name and renamed, so a reader never sees half a text.
+//
+// c: the cache to write to
+// key: the key of the contents
+// text: the text read from the contents
+void cache_write(Cache *c, Digest key, Text *text) {
+    if (c->dir == NULL) {
+        return;
+    }
+    char path[4096], temp[4096];
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%ld", (long) getpid());
+    key_path(c, key, "", path, sizeof(path));
+    key_path(c, key, suffix, temp, sizeof(temp));
+    FILE *f = fopen(temp, "wb");
+    if (f == NULL) {
+        return;
+    }
+    bool ok = text_write(text, f);
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(temp, path) != 0) {
+        unlink(temp);
+    }
+    return;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "digest.h"
+#include "ns.h"
+#include "text.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct Cache Cache;
+
+Cache *cache_create(char *dir, NoiseSet *noise);
+
+void cache_delete(Cache **c);
+
+Digest cache_key(Cache *c, char *data, size_t length);
+
+bool cache_find_dist(Cache *c, Digest key, double *dist);
+
+void cache_add_dist(Cache *c, Digest key, double dist);
+
+Text *cache_read(Cache *c, Digest key);
+
+void cache_write(Cache *c, Digest key, Text *text);
@@ -0,0 +1,249 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "cf.h"
+#include "digest.h"
+#include "salts.h"
+
+// Bin Fan, Dave G. Andersen, Michael Kaminsky and Michael D. Mitzenmacher,
+// "Cuckoo Filter: Practically Better Than Bloom," CoNEXT 2014.
+
+#define BUCKET    4 // fingerprints per bucket
+#define MAX_KICKS 500 // evictions tried before an insertion gives up
+
+// A set of 16-bit fingerprints, each in one of two buckets. The second bucket
+// is found from the first and the fingerprint alone, so fingerprints can be moved
+// between them without the word, and removed again, unlike bits of a BloomFilter.
+// A probe reads at most two buckets of 8 bytes each, and is wrong for an absent
+// word with probability about 2 * BUCKET * load / 2^16.
+struct CuckooFilter {
+    uint32_t mask; // number of buckets - 1, a power of 2 - 1
+    uint32_t count;
+    uint16_t *slots; // BUCKET slots per bucket, 0 is empty
+    uint64_t state; // xorshift state for choosing what to evict
+    bool stashed; // whether an evicted fingerprint found no room and waits here
+    uint32_t stash_index;
+    uint16_t stash_fp;
+};
+
+// Creates a new cuckoo filter.
+// Returns: a pointer to the filter, or NULL on failure.
+//
+// size: the number of fingerprint slots, rounded up to a power of 2 buckets
+CuckooFilter *cf_create(uint32_t size) {
+    CuckooFilter *cf = (CuckooFilter *) calloc(1, sizeof(CuckooFilter));
+    if (cf == NULL) {
+        return NULL;
+    }
+    uint32_t buckets = 1;
+    while (buckets * BUCKET < size && buckets < (1u << 30)) {
+        buckets <<= 1;
+    }
+    cf->mask = buckets - 1;
+    cf->state = SALT_PRIMARY_LO;
+    cf->slots = (uint16_t *) calloc((size_t) buckets * BUCKET, sizeof(uint16_t));
+    if (cf->slots == NULL) {
+        free(cf);
+        return NULL;
+    }
+    return cf;
+}
+
+// Deletes the given cuckoo filter.
+//
+// cf: a pointer to the address of the filter
+void cf_delete(CuckooFilter **cf) {
+    free((*cf)->slots);
+    free(*cf);
+    *cf = NULL;
+    return;
+}
+
+// Returns the number of fingerprint slots of the filter.
+//
+// cf: the filter
+uint32_t cf_size(CuckooFilter *cf) {
+    return (cf->mask + 1) * BUCKET;
+}
+
+// Returns the number of fingerprints stored in the filter.
+//
+// cf: the filter
+uint32_t cf_count(CuckooFilter *cf) {
+    return cf->count;
+}
+
+// Hashes a word to its fingerprint and first bucket.
+//
+// cf: the filter
+// word: the word to hash
+// fp: where to store the fingerprint, never 0
+// index: where to store the first bucket
+static inline void locate(CuckooFilter *cf, char *word, uint16_t *fp, uint32_t *index) {
+    Digest d = digest(word, strlen(word), SALT_PRIMARY_HI);
+    *fp = d.hi >> 48;
+    *fp += *fp == 0;
+    *index = d.lo & cf->mask;
+    return;
+}
+
+// Returns the other bucket a fingerprint can be in. Applying it twice gives the first back.
+//
+// cf: the filter
+// index: one bucket of the fingerprint
+// fp: the fingerprint
+static inline uint32_t alternate(CuckooFilter *cf, uint32_t index, uint16_t fp) {
+    return (index ^ (fp * 0x5bd1e995u)) & cf->mask;
+}
+
+// Returns whether the bucket holds the fingerprint.
+static inline bool bucket_has(CuckooFilter *cf, uint32_t index, uint16_t fp) {
+    uint16_t *b = &cf->slots[index * BUCKET];
+    return b[0] == fp || b[1] == fp || b[2] == fp || b[3] == fp;
+}
+
+// Puts the fingerprint in an empty slot of the bucket.
+// Returns: whether there was one.
+static inline bool bucket_put(CuckooFilter *cf, uint32_t index, uint16_t fp) {
+    uint16_t *b = &cf->slots[index * BUCKET];
+    for (int i = 0; i < BUCKET; i++) {
+        if (b[i] == 0) {
+            b[i] = fp;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Takes the fingerprint out of the bucket.
+// Returns: whether it was there.
+static inline bool bucket_take(CuckooFilter *cf, uint32_t index, uint16_t fp) {
+    uint16_t *b = &cf->slots[index * BUCKET];
+    for (int i = 0; i < BUCKET; i++) {
+        if (b[i] == fp) {
+            b[i] = 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Places a fingerprint, evicting others to their alternate buckets if both of its own are full.
+// Returns: whether it, and everything it evicted, found room; otherwise the last
+// evicted fingerprint is stashed.
+//
+// cf: the filter
+// index: one bucket of the fingerprint
+// fp: the fingerprint
+static bool place(CuckooFilter *cf, uint32_t index, uint16_t fp) {
+    if (bucket_put(cf, index, fp) || bucket_put(cf, alternate(cf, index, fp), fp)) {
+        return true;
+    }
+    for (int kick = 0; kick < MAX_KICKS; kick++) {
+        cf->state ^= cf->state << 13;
+        cf->state ^= cf->state >> 7;
+        cf->state ^= cf->state << 17;
+        uint16_t *slot = &cf->slots[index * BUCKET + (cf->state & (BUCKET - 1))];
+        uint16_t evicted = *slot;
+        *slot = fp;
+        fp = evicted;
+        index = alternate(cf, index, fp);
+        if (bucket_put(cf, index, fp)) {
+            return true;
+        }
+    }
+    cf->stashed = true;
+    cf->stash_index = index;
+    cf->stash_fp = fp;
+    return false;
+}
+
+// Inserts the word into the cuckoo filter. Every insertion stores another copy of
+// the word's fingerprint, so a word inserted twice is only gone after two removals,
+// and words that share a fingerprint and buckets each keep a copy of their own.
+// The two buckets hold at most 2 * BUCKET copies of one fingerprint.
+// Returns: whether the word is now in the filter, false if the filter is full.
+//
+// cf: the filter to insert into
+// word: the word to hash and insert into the filter
+bool cf_insert(CuckooFilter *cf, char *word) {
+    if (cf->stashed) { // already full, and evicting could lose a second fingerprint
+        return false;
+    }
+    uint16_t fp;
+    uint32_t index;
+    locate(cf, word, &fp, &index);
+    uint32_t other = alternate(cf, index, fp);
+    uint32_t copies = 0;
+    for (int i = 0; i < BUCKET; i++) {
+        copies += cf->slots[index * BUCKET + i] == fp;
+        copies += other != index && cf->slots[other * BUCKET + i] == fp;
+    }
+    if (copies == (other != index ? 2 : 1) * BUCKET) { // evictions would only swap copies
+        return false;
+    }
+    cf->count++;
+    place(cf, index, fp); // if it fails, the stash still holds the last fingerprint moved
+    return true;
+}
+
+// Probes the cuckoo filter for the given word.
+// Returns: whether or not the word is in the filter.
+// When returning false, this function is correct.
+// There may, however, be some false positives.
+//
+// cf: the filter to probe
+// word: the word to hash and probe for
+bool cf_probe(CuckooFilter *cf, char *word) {
+    uint16_t fp;
+    uint32_t index;
+    locate(cf, word, &fp, &index);
+    uint32_t other = alternate(cf, index, fp);
+    return bucket_has(cf, index, fp) || bucket_has(cf, other, fp)
+           || (cf->stashed && cf->stash_fp == fp
+               && (cf->stash_index == index || cf->stash_index == other));
+}
+
+// Removes one copy of the word's fingerprint from the cuckoo filter. Only words
+// that were inserted may be removed, or a word sharing its fingerprint would lose
+// its copy in their place.
+// Returns: whether the word's fingerprint was found and removed.
+//
+// cf: the filter to remove from
+// word: the word to remove
+bool cf_remove(CuckooFilter *cf, char *word) {
+    uint16_t fp;
+    uint32_t index;
+    locate(cf, word, &fp, &index);
+    uint32_t other = alternate(cf, index, fp);
+    if (cf->stashed && cf->stash_fp == fp
+        && (cf->stash_index == index || cf->stash_index == other)) {
+        cf->stashed = false;
+    } else if (!bucket_take(cf, index, fp) && !bucket_take(cf, other, fp)) {
+        return false;
+    }
+    cf->count--;
+    if (cf->stashed) { // there is room now, so the stashed fingerprint can go back
+        cf->stashed = false;
+        place(cf, cf->stash_index, cf->stash_fp);
+    }
+    return true;
+}
+
+// Debug function to print the cuckoo filter.
+//
+// cf: the filter to print
+void cf_print(CuckooFilter *cf) {
+    printf("Buckets: %" PRIu32 " Count: %" PRIu32 "\n", cf->mask + 1, cf->count);
+    for (uint32_t i = 0; i <= cf->mask; i++) {
+        uint16_t *b = &cf->slots[i * BUCKET];
+        printf("%04" PRIx16 " %04" PRIx16 " %04" PRIx16 " %04" PRIx16 "\n", b[0], b[1], b[2], b[3]);
+    }
+    if (cf->stashed) {
+        printf("Stash: %04" PRIx16 " in %" PRIu32 "\n", cf->stash_fp, cf->stash_index);
+    }
+    return;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct CuckooFilter CuckooFilter;
+
+CuckooFilter *cf_create(uint32_t size);
+
+void cf_delete(CuckooFilter **cf);
+
+uint32_t cf_size(CuckooFilter *cf);
+
+uint32_t cf_count(CuckooFilter *cf);
+
+bool cf_insert(CuckooFilter *cf, char *word);
+
+bool cf_probe(CuckooFilter *cf, char *word);
+
+bool cf_remove(CuckooFilter *cf, char *word);
+
+void cf_print(CuckooFilter *cf);
@@ -0,0 +1,62 @@
+#include <string.h>
+
+#include "digest.h"
+
+// Austin Appleby, "MurmurHash3", https://github.com/aappleby/smhasher, 2011.
+// The x64_128 variant, except that the tail is zero-padded into a full block.
+// This is a fast non-cryptographic hash: it tells texts apart, it does not
+// protect against anyone crafting collisions.
+
+#define C1 0x87c37b91114253d5
+#define C2 0x4cf5ad432745937f
+
+static inline uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+// Mixes one 16-byte block into the state.
+static inline void mix(uint64_t *h1, uint64_t *h2, char *block) {
+    uint64_t k1, k2;
+    memcpy(&k1, block, sizeof(uint64_t));
+    memcpy(&k2, block + sizeof(uint64_t), sizeof(uint64_t));
+    k1 *= C1;
+    k1 = rotl(k1, 31);
+    k1 *= C2;
+    *h1 ^= k1;
+    *h1 = rotl(*h1, 27) + *h2;
+    *h1 = *h1 * 5 + 0x52dce729;
+    k2 *= C2;
+    k2 = rotl(k2, 33);
+    k2 *= C1;
+    *h2 ^= k2;
+    *h2 = rotl(*h2, 31) + *h1;
+    *h2 = *h2 * 5 + 0x38495ab5;
+}
+
+// Computes the digest of the given bytes.
+// Returns: the digest.
+//
+// data: the bytes to digest
+// length: the number of bytes
+// seed: changes the digest, so different contexts get unrelated digests
+Digest digest(char *data, size_t length, uint64_t seed) {
+    uint64_t h1 = seed, h2 = seed;
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        mix(&h1, &h2, data + i);
+    }
+    if (i < length) {
+        char tail[16] = { 0 };
+        memcpy(tail, data + i, length - i);
+        mix(&h1, &h2, tail);
+    }
+    h1 ^= length;
+    h2 ^= length;
+    h1 += h2;
+    h2 += h1;
+    h1 = fmix(h1);
+    h2 = fmix(h2);
+    h1 += h2;
+    h2 += h1;
+    return (Digest) { .hi = h1, .lo = h2 };
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A 128-bit digest of some bytes.
+typedef struct {
+    uint64_t hi;
+    uint64_t lo;
+} Digest;
+
+// Final avalanche, so that every input bit affects every output bit.
+// Also spreads the bits of hashes that are used to pick table slots.
+// Returns: the mixed value.
+//
+// k: the value to mix
+static inline uint64_t fmix(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccd;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53;
+    k ^= k >> 33;
+    return k;
+}
+
+Digest digest(char *data, size_t length, uint64_t seed);
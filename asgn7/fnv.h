@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+
+#define FNV_OFFSET 0xcbf29ce484222325
+#define FNV_PRIME  0x100000001b3
+
+// Hashes the word with 64-bit FNV-1a.
+// This is much cheaper than SPECK for the short words we see, and is only
+// used by tables that are not exposed to adversarial input.
+// Returns: the hash of the word.
+//
+// word: the null-terminated word to hash
+static inline uint64_t fnv1a(char *word) {
+    uint64_t h = FNV_OFFSET;
+    for (unsigned char *c = (unsigned char *) word; *c != '\0'; c++) {
+        h ^= *c;
+        h *= FNV_PRIME;
+    }
+    return h;
+}
@@ -0,0 +1,312 @@
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "digest.h"
+#include "ft.h"
+#include "salts.h"
+#include "stats.h"
+
+// Word counts keyed by 64-bit fingerprints of the words, with the words themselves
+// thrown away, so every slot takes 12 bytes instead of a pointer to a Node and its
+// string. The table grows with the text, so it stays between three eighths and three
+// quarters full, at most 32 bytes per distinct word. Two different words with the same fingerprint are counted as one word.
+// The top two bits of a key hold its FeatureKind, so fingerprints have 62 bits, and
+// with n distinct words in a table a collision happens with probability about n^2 / 2^63:
+// under 10^-6 for a million words, and far less for any real text.
+//
+// In verify mode the words are kept next to their fingerprints and compared on every
+// hit, so collisions are counted (FP_COLLISIONS) rather than silently merged.
+struct FingerprintTable {
+    uint32_t size;
+    uint32_t count; // number of used slots
+    uint64_t *keys; // 0 marks an empty slot
+    uint32_t *counts;
+    char **words; // only in verify mode
+};
+
+// Creates a fingerprint table of the given size.
+// Returns: a pointer to the table, or NULL on failure.
+//
+// size: the number of slots to start with, FT_MIN_SLOTS unless more words are known to come
+// verify: whether to keep the words to detect collisions
+FingerprintTable *ft_create(uint32_t size, bool verify) {
+    FingerprintTable *ft = (FingerprintTable *) calloc(1, sizeof(FingerprintTable));
+    if (ft == NULL) {
+        return NULL;
+    }
+    ft->size = size;
+    ft->keys = (uint64_t *) calloc(size, sizeof(uint64_t));
+    ft->counts = (uint32_t *) calloc(size, sizeof(uint32_t));
+    ft->words = verify ? (char **) calloc(size, sizeof(char *)) : NULL;
+    if (ft->keys == NULL || ft->counts == NULL || (verify && ft->words == NULL)) {
+        ft_delete(&ft);
+        return NULL;
+    }
+    return ft;
+}
+
+// Deletes the fingerprint table.
+//
+// ft: a pointer to the address of the table
+void ft_delete(FingerprintTable **ft) {
+    if ((*ft)->words != NULL) {
+        for (uint32_t i = 0; i < (*ft)->size; i++) {
+            free((*ft)->words[i]);
+        }
+        free((*ft)->words);
+    }
+    free((*ft)->keys);
+    free((*ft)->counts);
+    free(*ft);
+    *ft = NULL;
+    return;
+}
+
+// Empties the table, keeping its slots for the next set of words.
+//
+// ft: the table
+void ft_clear(FingerprintTable *ft) {
+    if (ft->words != NULL) {
+        for (uint32_t i = 0; i < ft->size; i++) {
+            free(ft->words[i]);
+        }
+        memset(ft->words, 0, (size_t) ft->size * sizeof(char *));
+    }
+    memset(ft->keys, 0, (size_t) ft->size * sizeof(uint64_t));
+    memset(ft->counts, 0, (size_t) ft->size * sizeof(uint32_t));
+    ft->count = 0;
+    return;
+}
+
+// Returns the number of slots of the table.
+//
+// ft: the table
+uint32_t ft_size(FingerprintTable *ft) {
+    return ft->size;
+}
+
+// Returns the number of used slots of the table.
+//
+// ft: the table
+uint32_t ft_count(FingerprintTable *ft) {
+    return ft->count;
+}
+
+// Returns the number of bytes the table takes, with its words in verify mode.
+//
+// ft: the table
+uint64_t ft_bytes(FingerprintTable *ft) {
+    uint64_t bytes
+        = sizeof(FingerprintTable) + (uint64_t) ft->size * (sizeof(uint64_t) + sizeof(uint32_t));
+    if (ft->words != NULL) {
+        bytes += (uint64_t) ft->size * sizeof(char *);
+        for (uint32_t i = 0; i < ft->size; i++) {
+            bytes += ft->words[i] != NULL ? strlen(ft->words[i]) + 1 : 0;
+        }
+    }
+    return bytes;
+}
+
+// Calculates the fingerprint of a word.
+// Returns: the fingerprint, never 0.
+//
+// word: the word
+uint64_t ft_fingerprint(char *word) {
+    return ft_feature(digest(word, strlen(word), SALT_HASHTABLE_LO).lo, FT_WORD);
+}
+
+// Makes the key of a feature from a hash of it.
+// Returns: the key, never 0.
+//
+// hash: a 64-bit hash of the feature, its top two bits are dropped
+// kind: what the feature is
+uint64_t ft_feature(uint64_t hash, FeatureKind kind) {
+    uint64_t key = (hash & ((UINT64_C(1) << FT_KIND_SHIFT) - 1)) | (uint64_t) kind << FT_KIND_SHIFT;
+    return key == 0 ? 1 : key;
+}
+
+// Returns the kind of feature a key counts.
+//
+// key: the key
+FeatureKind ft_kind(uint64_t key) {
+    return (FeatureKind) (key >> FT_KIND_SHIFT);
+}
+
+// Finds the slot of a key, or the empty slot where it would go.
+// Returns: the index of the slot, or size if the table is full without the key.
+//
+// ft: the table
+// key: the fingerprint to look for
+// probes: where to store the number of slots looked at
+static uint32_t find(FingerprintTable *ft, uint64_t key, uint64_t *probes) {
+    uint32_t index = key % ft->size;
+    uint32_t original = index;
+    *probes = 1;
+    while (ft->keys[index] != 0 && ft->keys[index] != key) {
+        index = (index + 1) % ft->size;
+        (*probes)++;
+        if (index == original) {
+            return ft->size;
+        }
+    }
+    return index;
+}
+
+// Looks up how many times a word was counted.
+// Returns: the count, 0 if the word is not in the table.
+//
+// ft: the table
+// key: the fingerprint of the word
+uint32_t ft_lookup(FingerprintTable *ft, uint64_t key) {
+    uint64_t probes;
+    uint32_t index = find(ft, key, &probes);
+    stats_lookup(probes);
+    return index == ft->size ? 0 : ft->counts[index];
+}
+
+// Doubles the number of slots of the table, placing every fingerprint again.
+// Returns: whether it could be grown.
+//
+// ft: the table
+static bool grow(FingerprintTable *ft) {
+    if (ft->size > UINT32_MAX / 2) {
+        return false;
+    }
+    FingerprintTable old = *ft;
+    ft->size = 2 * old.size;
+    ft->keys = (uint64_t *) calloc(ft->size, sizeof(uint64_t));
+    ft->counts = (uint32_t *) calloc(ft->size, sizeof(uint32_t));
+    ft->words = old.words != NULL ? (char **) calloc(ft->size, sizeof(char *)) : NULL;
+    if (ft->keys == NULL || ft->counts == NULL || (old.words != NULL && ft->words == NULL)) {
+        free(ft->keys);
+        free(ft->counts);
+        free(ft->words);
+        *ft = old;
+        return false;
+    }
+    for (uint32_t i = 0; i < old.size; i++) {
+        if (old.keys[i] == 0) {
+            continue;
+        }
+        uint32_t index = old.keys[i] % ft->size;
+        while (ft->keys[index] != 0) {
+            index = (index + 1) % ft->size;
+        }
+        ft->keys[index] = old.keys[i];
+        ft->counts[index] = old.counts[i];
+        if (old.words != NULL) {
+            ft->words[index] = old.words[i];
+        }
+    }
+    free(old.keys);
+    free(old.counts);
+    free(old.words);
+    return true;
+}
+
+// Adds to the count of a fingerprint.
+// Returns: whether there was room for it.
+//
+// ft: the table
+// key: the fingerprint
+// word: the word it was taken from, only needed in verify mode, or NULL if there is none
+// count: how much to add
+static bool add(FingerprintTable *ft, uint64_t key, char *word, uint32_t count) {
+    if (4 * (uint64_t) (ft->count + 1) > 3 * (uint64_t) ft->size && !grow(ft)) {
+        return false;
+    }
+    uint64_t probes;
+    uint32_t index = find(ft, key, &probes);
+    if (index == ft->size) {
+        stats_insert(probes, false);
+        return false;
+    }
+    bool created = ft->keys[index] == 0;
+    stats_insert(probes, created);
+    if (created) {
+        ft->keys[index] = key;
+        ft->count++;
+        if (ft->words != NULL && word != NULL && (ft->words[index] = strdup(word)) == NULL) {
+            return false;
+        }
+    } else if (ft->words != NULL && word != NULL && ft->words[index] != NULL
+               && strcmp(ft->words[index], word) != 0) {
+        stats_count(FP_COLLISIONS, 1);
+    }
+    ft->counts[index] += count;
+    return true;
+}
+
+// Counts one occurrence of a word.
+// Returns: whether there was room for it.
+//
+// ft: the table
+// word: the word to count
+bool ft_insert(FingerprintTable *ft, char *word) {
+    return add(ft, ft_fingerprint(word), word, 1);
+}
+
+// Counts several occurrences of a word.
+// Returns: whether there was room for it.
+//
+// ft: the table
+// word: the word to count
+// count: the number of occurrences
+bool ft_add(FingerprintTable *ft, char *word, uint32_t count) {
+    return add(ft, ft_fingerprint(word), word, count);
+}
+
+// Counts several occurrences of a feature whose key is already known.
+// Returns: whether there was room for it.
+//
+// ft: the table
+// key: the key of the feature, from ft_fingerprint or ft_feature
+// word: the word the key was taken from, checked in verify mode, or NULL if it has none
+// count: the number of occurrences
+bool ft_add_key(FingerprintTable *ft, uint64_t key, char *word, uint32_t count) {
+    return add(ft, key, word, count);
+}
+
+// Adds every count of one table to another.
+// Returns: whether there was room for all of them.
+//
+// ft: the table to add to
+// src: the table to add
+bool ft_merge(FingerprintTable *ft, FingerprintTable *src) {
+    for (uint32_t i = 0; i < src->size; i++) {
+        if (src->keys[i] != 0
+            && !add(ft, src->keys[i], src->words != NULL ? src->words[i] : NULL, src->counts[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Reads one slot of the table, for iterating over it.
+// Returns: whether the slot is used.
+//
+// ft: the table
+// i: the index of the slot, less than ft_size
+// key: where to store the fingerprint
+// count: where to store the count
+bool ft_slot(FingerprintTable *ft, uint32_t i, uint64_t *key, uint32_t *count) {
+    *key = ft->keys[i];
+    *count = ft->counts[i];
+    return *key != 0;
+}
+
+// Debug function to print the table.
+//
+// ft: the table to print
+void ft_print(FingerprintTable *ft) {
+    printf("Size: %" PRIu32 " Count: %" PRIu32 "\n", ft->size, ft->count);
+    for (uint32_t i = 0; i < ft->size; i++) {
+        if (ft->keys[i] != 0) {
+            printf("%016" PRIx64 " %s: %" PRIu32 "\n", ft->keys[i],
+                ft->words != NULL && ft->words[i] != NULL ? ft->words[i] : "", ft->counts[i]);
+        }
+    }
+    return;
+}
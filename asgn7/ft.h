@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct FingerprintTable FingerprintTable;
+
+// What a key counts, kept in its top two bits so features of different kinds never share a key.
+typedef enum { FT_WORD, FT_BIGRAM, FT_CHAR_NGRAM, FT_KINDS } FeatureKind;
+
+#define FT_KIND_SHIFT 62
+
+// The slots a table starts with. It doubles whenever it would be more than three quarters full.
+#define FT_MIN_SLOTS 1024
+
+FingerprintTable *ft_create(uint32_t size, bool verify);
+
+void ft_delete(FingerprintTable **ft);
+
+void ft_clear(FingerprintTable *ft);
+
+uint32_t ft_size(FingerprintTable *ft);
+
+uint32_t ft_count(FingerprintTable *ft);
+
+uint64_t ft_bytes(FingerprintTable *ft);
+
+uint64_t ft_fingerprint(char *word);
+
+uint64_t ft_feature(uint64_t hash, FeatureKind kind);
+
+FeatureKind ft_kind(uint64_t key);
+
+uint32_t ft_lookup(FingerprintTable *ft, uint64_t key);
+
+bool ft_insert(FingerprintTable *ft, char *word);
+
+bool ft_add(FingerprintTable *ft, char *word, uint32_t count);
+
+bool ft_add_key(FingerprintTable *ft, uint64_t key, char *word, uint32_t count);
+
+bool ft_merge(FingerprintTable *ft, FingerprintTable *src);
+
+bool ft_slot(FingerprintTable *ft, uint32_t i, uint64_t *key, uint32_t *count);
+
+void ft_print(FingerprintTable *ft);
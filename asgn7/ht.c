@@ -7,14 +7,33 @@
 #include "salts.h"
 #include "node.h"
 #include "speck.h"
+#include "stats.h"
 
-uint64_t ht_lookups = 0, lookup_probes = 0, ht_insertions = 0, insertion_probes = 0, used_slots = 0;
+// Nodes are not allocated one by one but carved out of blocks like this one,
+// each node followed by its word, so that emptying the table frees nothing.
+#define BLOCK_SIZE (1 << 16)
+
+// The filled list starts with room for this many slots, and doubles when full.
+#define MIN_FILLED 1024
+
+typedef struct Block {
+    struct Block *next;
+    size_t size;
+    size_t used;
+    char data[];
+} Block;
 
 // copied from assignment
 struct HashTable {
     uint64_t salt[2];
     uint32_t size;
+    uint32_t count; // number of used slots
     Node **slots;
+    uint32_t *filled; // the index of every used slot, in the order they were filled
+    uint32_t filled_capacity;
+    Block *blocks; // every block of nodes, kept by ht_clear for the next set of words
+    Block *current; // the block nodes are being taken from, blocks after it are unused
+    uint64_t block_bytes;
 };
 
 // Creates a hash table of the given size.
@@ -23,10 +42,14 @@ struct HashTable {
 // size: the size of the array used for the hash table
 HashTable *ht_create(uint32_t size) {
     HashTable *ht = (HashTable *) malloc(sizeof(HashTable));
-    used_slots = 0;
     ht->salt[0] = SALT_HASHTABLE_LO;
     ht->salt[1] = SALT_HASHTABLE_HI;
     ht->size = size;
+    ht->count = 0;
+    ht->filled = NULL;
+    ht->filled_capacity = 0;
+    ht->blocks = ht->current = NULL;
+    ht->block_bytes = 0;
     ht->slots = (Node **) calloc(size, sizeof(Node *));
     if (ht->slots == NULL) {
         free(ht);
@@ -39,18 +62,36 @@ HashTable *ht_create(uint32_t size) {
 //
 // ht: a pointer to the address of the hash table
 void ht_delete(HashTable **ht) {
-    for (uint32_t i = 0; i < (*ht)->size; i++) {
-        if ((*ht)->slots[i] == NULL) {
-            continue;
-        }
-        node_delete(&((*ht)->slots[i]));
+    Block *b = (*ht)->blocks;
+    while (b != NULL) {
+        Block *next = b->next;
+        free(b);
+        b = next;
     }
+    free((*ht)->filled);
     free((*ht)->slots);
     free(*ht);
     *ht = NULL;
     return;
 }
 
+// Empties the hash table without freeing anything: only the used slots are
+// cleared, and the blocks the nodes were taken from are handed out again,
+// so refilling it allocates nothing until it holds more than it did before.
+//
+// ht: the hash table to empty
+void ht_clear(HashTable *ht) {
+    for (uint32_t i = 0; i < ht->count; i++) {
+        ht->slots[ht->filled[i]] = NULL;
+    }
+    ht->count = 0;
+    for (Block *b = ht->blocks; b != NULL; b = b->next) {
+        b->used = 0;
+    }
+    ht->current = ht->blocks;
+    return;
+}
+
 // Returns the size of the hash table.
 //
 // ht: the hash table to get the size of
@@ -58,6 +99,64 @@ uint32_t ht_size(HashTable *ht) {
     return ht->size;
 }
 
+// Returns the number of used slots in the hash table.
+//
+// ht: the hash table to get the count of
+uint32_t ht_count(HashTable *ht) {
+    return ht->count;
+}
+
+// Returns the number of bytes the hash table takes, with the blocks its nodes are taken from.
+//
+// ht: the hash table
+uint64_t ht_bytes(HashTable *ht) {
+    return sizeof(HashTable) + (uint64_t) ht->size * sizeof(Node *)
+           + (uint64_t) ht->filled_capacity * sizeof(uint32_t) + ht->block_bytes;
+}
+
+// Goes to the next existing entry in the hash table, like ht_iter but with
+// the position kept by the caller, so nothing is allocated to iterate.
+// Returns: the next entry, or NULL if the end of the table was reached.
+//
+// ht: the hash table
+// slot: the position, 0 to start from the beginning, advanced past the entry
+Node *ht_next(HashTable *ht, uint32_t *slot) {
+    while (*slot < ht->size) {
+        Node *next = ht->slots[(*slot)++];
+        if (next != NULL) {
+            return next;
+        }
+    }
+    return NULL;
+}
+
+// Finds the longest run of consecutive used slots, wrapping around the end.
+// Linear probing makes these clusters grow, so this is a measure of how
+// long unsuccessful probes can get.
+// Returns: the length of the run.
+//
+// ht: the hash table to scan
+uint32_t ht_longest_run(HashTable *ht) {
+    if (ht->count == ht->size) {
+        return ht->size;
+    }
+    // start right after an empty slot so that no run is split by the wrap
+    uint32_t start = 0;
+    while (ht->slots[start] != NULL) {
+        start++;
+    }
+    uint32_t longest = 0, run = 0;
+    for (uint32_t i = 1; i <= ht->size; i++) {
+        if (ht->slots[(start + i) % ht->size] != NULL) {
+            run++;
+            longest = run > longest ? run : longest;
+        } else {
+            run = 0;
+        }
+    }
+    return longest;
+}
+
 // Attempts to find the given word in the hash table.
 // Returns: the found node containing the word, or NULL if it was not found.
 //
@@ -66,17 +165,77 @@ uint32_t ht_size(HashTable *ht) {
 Node *ht_lookup(HashTable *ht, char *word) {
     uint32_t index = hash(ht->salt, word) % ht->size;
     uint32_t original = index;
-    ht_lookups++;
-    while (
-        ++lookup_probes && ht->slots[index] != NULL && strcmp(ht->slots[index]->word, word) != 0) {
+    uint64_t probes = 1;
+    while (ht->slots[index] != NULL && strcmp(ht->slots[index]->word, word) != 0) {
         index = (index + 1) % ht->size; // continue until empty index is found or word is found
+        probes++;
         if (index == original) { // we have looped back to the original
+            stats_lookup(probes);
             return NULL; // not in table
         }
     }
+    stats_lookup(probes);
     return ht->slots[index]; // return found Node *
 }
 
+// Makes room for more slots in the filled list.
+// Returns: whether there was memory for it.
+//
+// ht: the hash table
+static bool grow_filled(HashTable *ht) {
+    uint32_t capacity = ht->filled_capacity > 0 ? 2 * ht->filled_capacity : MIN_FILLED;
+    capacity = capacity < ht->size ? capacity : ht->size;
+    uint32_t *filled = (uint32_t *) realloc(ht->filled, capacity * sizeof(uint32_t));
+    if (filled == NULL) {
+        return false;
+    }
+    ht->filled = filled;
+    ht->filled_capacity = capacity;
+    return true;
+}
+
+// Takes a node for a word from the current block, moving on to the next block,
+// or allocating one if there is none left, when it does not fit.
+// Returns: the node with a count of 0, or NULL if there was no memory for it.
+//
+// ht: the hash table
+// word: the word the node holds, copied into the block after it
+static Node *take_node(HashTable *ht, char *word) {
+    size_t length = strlen(word) + 1;
+    size_t bytes = (sizeof(Node) + length + sizeof(Node *) - 1) & ~(sizeof(Node *) - 1);
+    Block *b = ht->current;
+    while (b != NULL && b->used + bytes > b->size) {
+        if (b->next == NULL) {
+            break;
+        }
+        b = b->next;
+    }
+    if (b == NULL || b->used + bytes > b->size) {
+        size_t size = bytes > BLOCK_SIZE ? bytes : BLOCK_SIZE;
+        Block *fresh = (Block *) malloc(sizeof(Block) + size);
+        if (fresh == NULL) {
+            return NULL;
+        }
+        fresh->next = NULL;
+        fresh->size = size;
+        fresh->used = 0;
+        if (b == NULL) {
+            ht->blocks = fresh;
+        } else {
+            b->next = fresh;
+        }
+        ht->block_bytes += sizeof(Block) + size;
+        b = fresh;
+    }
+    ht->current = b;
+    Node *n = (Node *) (b->data + b->used);
+    b->used += bytes;
+    n->word = (char *) (n + 1);
+    memcpy(n->word, word, length);
+    n->count = 0;
+    return n;
+}
+
 // Attempts to insert the given word into the hash table.
 // Returns: the created node, or NULL if there was no room left.
 //
@@ -85,17 +244,24 @@ Node *ht_lookup(HashTable *ht, char *word) {
 Node *ht_insert(HashTable *ht, char *word) {
     uint32_t index = hash(ht->salt, word) % ht->size;
     uint32_t original = index;
-    ht_insertions++;
-    while (++insertion_probes && ht->slots[index] != NULL
-           && strcmp(ht->slots[index]->word, word) != 0) {
+    uint64_t probes = 1;
+    while (ht->slots[index] != NULL && strcmp(ht->slots[index]->word, word) != 0) {
         index = (index + 1) % ht->size;
+        probes++;
         if (index == original) { // back to start
+            stats_insert(probes, false);
             return NULL; // could not be inserted
         }
     }
+    stats_insert(probes, ht->slots[index] == NULL);
     if (ht->slots[index] == NULL) { // need to create node if null
-        ht->slots[index] = node_create(word);
-        used_slots++;
+        if (ht->count == ht->filled_capacity && !grow_filled(ht)) {
+            return NULL;
+        }
+        if ((ht->slots[index] = take_node(ht, word)) == NULL) {
+            return NULL;
+        }
+        ht->filled[ht->count++] = index;
     }
     ht->slots[index]->count++;
     return ht->slots[index];
@@ -12,8 +12,18 @@ HashTable *ht_create(uint32_t size);
 
 void ht_delete(HashTable **ht);
 
+void ht_clear(HashTable *ht);
+
 uint32_t ht_size(HashTable *ht);
 
+uint32_t ht_count(HashTable *ht);
+
+uint64_t ht_bytes(HashTable *ht);
+
+Node *ht_next(HashTable *ht, uint32_t *slot);
+
+uint32_t ht_longest_run(HashTable *ht);
+
 Node *ht_lookup(HashTable *ht, char *word);
 
 Node *ht_insert(HashTable *ht, char *word);
@@ -3,27 +3,85 @@
 #include <inttypes.h>
 #include <string.h>
 #include <unistd.h>
+#include <getopt.h>
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 
+#include "cache.h"
+#include "library.h"
+#include "matrix.h"
 #include "metric.h"
+#include "ns.h"
+#include "parser.h"
+#include "prefetch.h"
 #include "pq.h"
+#include "stats.h"
 #include "text.h"
+#include "window.h"
 
 #define FLAG_FORMAT "   -%c %-12s %-s\n"
+#define LONG_FORMAT "   --%-11s %-s\n"
 #define MAX_STRING  100
 
-// for statistics
-extern uint64_t ht_lookups;
-extern uint64_t lookup_probes;
-extern uint64_t ht_insertions;
-extern uint64_t insertion_probes;
-extern uint64_t bf_false_positives;
-extern uint64_t bf_lookups;
-// reset for every hash table creation
-extern uint64_t used_slots;
+// The number of the anonymous text's most frequent words used for --deadline estimates.
+#define ESTIMATE_TERMS 64
 
-extern uint32_t hash_table_size, bloom_filter_size;
+extern uint32_t hash_table_size, bloom_filter_size, text_threads;
+extern uint32_t sketch_width, sketch_depth, sketch_heavy;
+extern bool text_fingerprints, text_verify;
+extern bool text_bigrams;
+extern uint32_t text_char_ngrams;
+
+// Options that only have a long form.
+enum { OPT_MATRIX = 256, OPT_SKETCH, OPT_SKETCH_WIDTH, OPT_SKETCH_DEPTH, OPT_HEAVY_HITTERS,
+    OPT_FINGERPRINTS, OPT_VERIFY_FINGERPRINTS, OPT_WINDOW, OPT_CENTROIDS,
+    OPT_RESIDENT, OPT_DEADLINE, OPT_BIGRAMS, OPT_CHAR_NGRAMS, OPT_WORKERS,
+    OPT_PACKED, OPT_MEM_LIMIT };
+
+static struct option long_options[] = {
+    { "matrix", required_argument, NULL, OPT_MATRIX },
+    { "sketch", no_argument, NULL, OPT_SKETCH },
+    { "sketch-width", required_argument, NULL, OPT_SKETCH_WIDTH },
+    { "sketch-depth", required_argument, NULL, OPT_SKETCH_DEPTH },
+    { "heavy-hitters", required_argument, NULL, OPT_HEAVY_HITTERS },
+    { "fingerprints", no_argument, NULL, OPT_FINGERPRINTS },
+    { "verify-fingerprints", no_argument, NULL, OPT_VERIFY_FINGERPRINTS },
+    { "window", required_argument, NULL, OPT_WINDOW },
+    { "centroids", no_argument, NULL, OPT_CENTROIDS },
+    { "resident", no_argument, NULL, OPT_RESIDENT },
+    { "deadline", required_argument, NULL, OPT_DEADLINE },
+    { "bigrams", no_argument, NULL, OPT_BIGRAMS },
+    { "char-ngrams", required_argument, NULL, OPT_CHAR_NGRAMS },
+    { "workers", required_argument, NULL, OPT_WORKERS },
+    { "packed", no_argument, NULL, OPT_PACKED },
+    { "mem-limit", required_argument, NULL, OPT_MEM_LIMIT },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 },
+};
+
+// Everything set from the command line.
+typedef struct {
+    char *db_name;
+    char *noise_file_name;
+    uint32_t matches;
+    Metric metric;
+    uint32_t noiselimit;
+    uint32_t prefetch_depth;
+    char *cache_dir;
+    bool verbose;
+    char *json_name;
+    char *matrix_name;
+    bool sketch;
+    uint32_t window;
+    bool centroids;
+    bool resident;
+    uint64_t deadline; // when to stop refining distances, in stats_now time, or 0
+    uint32_t workers; // processes to score the library in, 0 or 1 to score it in this one
+    bool packed;
+    uint64_t mem_limit; // bytes to fit the run under, or 0
+} Options;
 
 // Shows program usage and exits the program.
 //
@@ -33,8 +91,11 @@ void usage(char *arg0) {
     printf("   Identifies the most likely author of a text.\n\n");
 
     printf("USAGE\n");
-    printf("   %s [-d database] [-n noise] [-k matches] [-l noise_amount] [-e|m|c] [-v] [-H size] "
-           "[-B size] [-h]\n\n",
+    printf("   %s [-d database] [-n noise] [-k matches] [-l noise_amount] [-e|m|c] [-v] [-j stats] "
+           "[-t threads] [-p depth] [-C dir] [-H size] [-B size] [--matrix file] [--sketch] "
+           "[--sketch-width size] [--sketch-depth rows] [--heavy-hitters count] [--fingerprints] "
+           "[--verify-fingerprints] [--window words] [--centroids] [--resident] [--deadline ms] "
+           "[--bigrams] [--char-ngrams n] [--workers count] [--packed] [--mem-limit MB] [-h]\n\n",
         arg0);
 
     printf("OPTIONS\n");
@@ -50,9 +111,62 @@ void usage(char *arg0) {
     printf(FLAG_FORMAT, 'm', "", "Sets the distance formula to use Manhattan distance.");
     printf(FLAG_FORMAT, 'c', "", "Sets the distance formula to use Cosine distance.");
     printf(FLAG_FORMAT, 'v', "", "Enables verbose output.");
+    printf(FLAG_FORMAT, 'j', "stats",
+        "Times each stage and writes all statistics as JSON to the file (- for stdout).");
+    printf(FLAG_FORMAT, 't', "threads",
+        "Sets the number of threads used to read large files. (default: number of CPUs)");
+    printf(FLAG_FORMAT, 'p', "depth",
+        "Sets how many library files to read ahead in the background, 0 to disable. (default: "
+        "4)");
+    printf(FLAG_FORMAT, 'C', "dir",
+        "Keeps the word counts of library texts in this directory, so later runs can skip "
+        "reading them.");
     printf(FLAG_FORMAT, 'H', "size", "Specifies the hash table size (default 1 << 19).");
     printf(FLAG_FORMAT, 'B', "size", "Specifies the Bloom filter size (default 1 << 21).");
     printf(FLAG_FORMAT, 'h', "", "Shows this message for program help and usage.");
+    printf(LONG_FORMAT, "matrix file",
+        "Writes the distance between every pair of library texts to the file, as CSV, or as "
+        "binary if the name ends in .bin, instead of reading standard input.");
+    printf(LONG_FORMAT, "sketch",
+        "Counts the anonymous text approximately in fixed memory, and prints a bound on the "
+        "error of the distances.");
+    printf(LONG_FORMAT, "sketch-width size",
+        "Sets the number of counters per row of the sketch. (default: 1 << 16)");
+    printf(LONG_FORMAT, "sketch-depth rows", "Sets the number of rows of the sketch. (default: 5)");
+    printf(LONG_FORMAT, "heavy-hitters count",
+        "Sets how many of the most frequent words the sketch keeps. (default: 10000)");
+    printf(LONG_FORMAT, "fingerprints",
+        "Counts words by 64-bit fingerprints without keeping the words, in a table that grows "
+        "with the text, using less memory per word.");
+    printf(LONG_FORMAT, "verify-fingerprints",
+        "Like --fingerprints, but keeps the words to count fingerprint collisions.");
+    printf(LONG_FORMAT, "window words",
+        "Slides a window of this many words over standard input, and prints the closest "
+        "author of each stretch of windows instead of the whole text.");
+    printf(LONG_FORMAT, "centroids",
+        "Averages the texts of each author into one profile, and ranks authors instead of texts.");
+    printf(LONG_FORMAT, "resident",
+        "Loads the whole library before scoring, so words no library text has are only looked "
+        "at once.");
+    printf(LONG_FORMAT, "deadline ms",
+        "Ranks a cheap estimate of every distance first, then computes exact distances, closest "
+        "estimates first, until this many milliseconds after starting. Only this refinement is "
+        "bounded: the whole library and standard input are read first, however long that takes. "
+        "Implies --resident.");
+    printf(LONG_FORMAT, "bigrams",
+        "Also compares the frequencies of pairs of consecutive words. Implies --fingerprints.");
+    printf(LONG_FORMAT, "char-ngrams n",
+        "Also compares the frequencies of runs of n characters within words. Implies "
+        "--fingerprints.");
+    printf(LONG_FORMAT, "workers count",
+        "Splits the library between this many worker processes, each scoring its share "
+        "and sending back its closest matches. (default: 1)");
+    printf(LONG_FORMAT, "packed",
+        "Keeps the library's profiles packed to a few bytes per word, and prints a bound on "
+        "the error of the distances. Implies --resident.");
+    printf(LONG_FORMAT, "mem-limit MB",
+        "Uses fewer threads, reads fewer files ahead and starts fewer workers until the run "
+        "is expected to fit in this many megabytes.");
     exit(1);
     return;
 }
@@ -71,114 +185,893 @@ FILE *open_read(char *name, char *arg0) {
     return f;
 }
 
-int main(int argc, char *argv[]) {
-    // defaults
-    char *db_name = "lib.db";
-    char *noise_file_name = "noise.txt";
-    uint32_t matches = 5;
-    Metric metric = EUCLIDEAN;
-    bool verbose = false;
-
-    // parse options
-    int option;
-    while ((option = getopt(argc, argv, "d:n:k:l:emcvH:B:h")) != -1) {
-        switch (option) {
-        case 'd': db_name = optarg; break;
-        case 'n': noise_file_name = optarg; break;
-        case 'k': matches = strtoul(optarg, NULL, 10); break;
-        case 'l': noiselimit = strtoul(optarg, NULL, 10); break;
-        case 'e': metric = EUCLIDEAN; break;
-        case 'm': metric = MANHATTAN; break;
-        case 'c': metric = COSINE; break;
-        case 'v': verbose = true; break;
-        case 'H': hash_table_size = strtoul(optarg, NULL, 10); break;
-        case 'B': bloom_filter_size = strtoul(optarg, NULL, 10); break;
-        case 'h':
-        default: usage(argv[0]); break;
-        }
+// Frees the author names and paths read from the database.
+//
+// authors: the author names, entries may be NULL
+// paths: the paths of the texts
+// count: the number of entries
+void free_entries(char **authors, char **paths, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        free(authors[i]);
+        free(paths[i]);
     }
+    free(authors);
+    free(paths);
+    return;
+}
 
-    FILE *database = open_read(db_name, argv[0]);
-    FILE *noise_file = open_read(noise_file_name, argv[0]);
-
-    // create noise
-    Text *noise_text = text_create(noise_file, NULL);
-    fclose(noise_file);
-
-    Text *anon_text = text_create(stdin, noise_text);
-
+// Reads every entry of the database.
+// Returns: the number of entries, with the authors and paths allocated, or -1 on failure.
+//
+// database: the database file
+// db_name: the name of the database, for errors
+// authors: where to store the authors
+// paths: where to store the paths
+int64_t read_database(FILE *database, char *db_name, char ***authors, char ***paths) {
     uint32_t texts;
-    if (!fscanf(database, "%" SCNu32 "\n", &texts)) {
+    if (fscanf(database, "%" SCNu32 "\n", &texts) != 1) {
         fprintf(stderr, "Could not scan the number of texts from %s.\n", db_name);
-        return 1;
+        return -1;
     }
-
-    PriorityQueue *pq = pq_create(texts);
-
+    *authors = (char **) calloc(texts, sizeof(char *));
+    *paths = (char **) calloc(texts, sizeof(char *));
     char *text_author = (char *) calloc(MAX_STRING, sizeof(char));
     char *text_path = (char *) calloc(MAX_STRING, sizeof(char));
-    double average_ht_load = 0; // used to calculate the average fill of the HT
-    double max_ht_load = 0;
     for (uint32_t i = 0; i < texts; i++) {
         if (!fgets(text_author, MAX_STRING, database) || !fgets(text_path, MAX_STRING, database)) {
             fprintf(stderr, "Could not scan database entry #%" PRIu32 ".\n", i + 1);
+            free_entries(*authors, *paths, i);
             free(text_author);
             free(text_path);
-            return 1;
+            return -1;
         }
         text_author[strlen(text_author) - 1] = '\0'; // remove newlines
         text_path[strlen(text_path) - 1] = '\0';
-        // don't use open_read because we don't
-        // want to exit if the file couldn't be opened
-        FILE *text_file = fopen(text_path, "r");
-        if (text_file == NULL) {
-            fprintf(stderr, "File %s could not be opened.\n", text_path);
+        (*authors)[i] = strdup(text_author);
+        (*paths)[i] = strdup(text_path);
+    }
+    free(text_author);
+    free(text_path);
+    return texts;
+}
+
+// Scores every library text against the anonymous text, reading them one at a time.
+// Returns: a queue of the authors by distance, or NULL on failure.
+//
+// opts: the command line options
+// authors: the author of each text, taken by the queue
+// paths: the path of each text
+// texts: the number of texts
+// noise: the noise words to ignore
+// cache: the cache of texts read before
+// anon_text: the anonymous text
+// error: where to store the largest error any distance may have, if the anonymous text is sketched
+PriorityQueue *score_texts(Options *opts, char **authors, char **paths, uint32_t texts,
+    NoiseSet *noise, Cache *cache, Text *anon_text, double *error) {
+    *error = 0;
+    PriorityQueue *pq = pq_create(texts);
+    // every text is counted into this one and reset after, so no tables are allocated per text
+    Text *scratch = text_create_scratch();
+    // every file is read into one of its buffers, so no memory is allocated per file either
+    Prefetcher *pf = pf_create(paths, texts, opts->prefetch_depth);
+    if (pq == NULL || scratch == NULL || pf == NULL) {
+        if (pq != NULL) {
+            pq_delete(&pq);
+        }
+        if (scratch != NULL) {
+            text_delete(&scratch);
+        }
+        if (pf != NULL) {
+            pf_delete(&pf);
+        }
+        return NULL;
+    }
+    for (uint32_t i = 0; i < texts; i++) {
+        size_t length;
+        char *data = pf_take(pf, paths[i], &length);
+        if (data == NULL) {
+            fprintf(stderr, "File %s could not be opened.\n", paths[i]);
+            continue;
+        }
+        // the same contents always give the same distance, whatever the author
+        Digest key = cache_key(cache, data, length);
+        double dist;
+        if (cache_find_dist(cache, key, &dist)) {
+            enqueue(pq, authors[i], dist);
+            authors[i] = NULL;
+            continue;
+        }
+        Text *text = cache_read(cache, key);
+        if (text == NULL) {
+            text = text_fill_buffer(scratch, data, length, noise);
+            if (text != NULL) {
+                cache_write(cache, key, text);
+            }
+        }
+        if (text == NULL) {
             continue;
         }
-        // creates and fills the hash table, updating used_slots
-        Text *text = text_create(text_file, noise_text);
-        double load = used_slots / (double) hash_table_size;
-        average_ht_load += load;
-        if (load > max_ht_load) {
-            max_ht_load = load;
+        stats_load(text_load(text));
+        if (opts->verbose || opts->json_name != NULL) { // a full scan, so only when reported
+            stats_run(text_longest_run(text));
+        }
+        stats_count(TEXTS, 1);
+        uint64_t mark = stats_start();
+        dist = text_dist(text, anon_text, opts->metric);
+        mark = stats_stop(DISTANCE, mark);
+        if (opts->sketch) {
+            double bound = text_error(text, anon_text, opts->metric);
+            *error = bound > *error ? bound : *error;
+        }
+        cache_add_dist(cache, key, dist);
+        enqueue(pq, authors[i], dist);
+        authors[i] = NULL; // the queue owns it now
+        stats_stop(RANK, mark);
+        if (text == scratch) {
+            text_reset(scratch);
+        } else {
+            text_delete(&text);
         }
-        double dist = text_dist(text, anon_text, metric);
-        text_delete(&text);
-        enqueue(pq, strdup(text_author), dist);
-        fclose(text_file);
     }
-    average_ht_load /= texts;
-    fclose(database);
-    text_delete(&noise_text);
-    text_delete(&anon_text);
-    free(text_author);
-    free(text_path);
+    text_delete(&scratch);
+    pf_delete(&pf);
+    return pq;
+}
 
+// Scores one shard of the library in a worker process, and writes its closest
+// matches to the parent: the error bound, the number of matches, each match as the
+// length of its author, the author and its distance, and last the worker's stats.
+// Returns: the exit status of the worker.
+//
+// opts: the command line options
+// authors: the author of each text of the shard
+// paths: the path of each text of the shard
+// texts: the number of texts in the shard
+// noise: the noise words to ignore
+// cache: the cache of texts read before
+// anon_text: the anonymous text
+// fd: the write end of the pipe to the parent
+static int run_shard(Options *opts, char **authors, char **paths, uint32_t texts,
+    NoiseSet *noise, Cache *cache, Text *anon_text, int fd) {
+    FILE *out = fdopen(fd, "w");
+    if (out == NULL) {
+        return 1;
+    }
+    double error;
+    PriorityQueue *pq = score_texts(opts, authors, paths, texts, noise, cache, anon_text, &error);
+    if (pq == NULL) {
+        fclose(out);
+        return 1;
+    }
+    uint32_t count = pq_size(pq) < opts->matches ? pq_size(pq) : opts->matches;
+    bool ok = fwrite(&error, sizeof(error), 1, out) == 1
+              && fwrite(&count, sizeof(count), 1, out) == 1;
     char *author;
     double dist;
-    printf("Top %" PRIu32 ", metric: %s, noise limit: %" PRIu32 "\n", matches, metric_names[metric],
-        noiselimit);
-    for (uint32_t i = 1; i <= matches && dequeue(pq, &author, &dist); i++) {
-        printf("%" PRIu32 ") %s [%17.15f]\n", i, author, dist);
+    for (uint32_t i = 0; ok && i < count && dequeue(pq, &author, &dist); i++) {
+        uint16_t length = strlen(author);
+        ok = fwrite(&length, sizeof(length), 1, out) == 1
+             && fwrite(author, 1, length, out) == length
+             && fwrite(&dist, sizeof(dist), 1, out) == 1;
         free(author);
     }
     pq_delete(&pq);
-    if (verbose) {
+    Stats stats;
+    stats_collect(&stats);
+    ok = ok && fwrite(&stats, sizeof(stats), 1, out) == 1;
+    return fclose(out) == 0 && ok ? 0 : 1;
+}
+
+// Reads the matches a worker wrote into the queue, and merges its stats.
+// Returns: whether the worker wrote everything.
+//
+// in: the read end of the worker's pipe
+// pq: the queue to add the matches to
+// error: the largest error bound so far, updated with the worker's
+static bool gather_shard(FILE *in, PriorityQueue *pq, double *error) {
+    double bound;
+    uint32_t count;
+    if (fread(&bound, sizeof(bound), 1, in) != 1 || fread(&count, sizeof(count), 1, in) != 1) {
+        return false;
+    }
+    *error = bound > *error ? bound : *error;
+    char author[UINT16_MAX + 1];
+    for (uint32_t i = 0; i < count; i++) {
+        uint16_t length;
+        double dist;
+        if (fread(&length, sizeof(length), 1, in) != 1
+            || fread(author, 1, length, in) != length || fread(&dist, sizeof(dist), 1, in) != 1) {
+            return false;
+        }
+        author[length] = '\0';
+        enqueue(pq, strdup(author), dist);
+    }
+    Stats stats;
+    if (fread(&stats, sizeof(stats), 1, in) != 1) {
+        return false;
+    }
+    stats_merge(&stats);
+    return true;
+}
+
+// Scores every library text against the anonymous text in opts->workers processes.
+// The library is cut into one contiguous shard per worker, each worker scores its
+// shard on its own with score_texts and sends back only its closest opts->matches,
+// and those are merged here. The closest matches overall are always among them,
+// so the result is that of score_texts, though equal distances may come out in
+// another order. Workers share nothing but the pipes: each has its own allocator,
+// tables and counters, and the parent adds up their stats at the end.
+// Returns: a queue of the closest matches by distance, or NULL on failure.
+//
+// opts: the command line options
+// authors: the author of each text
+// paths: the path of each text
+// texts: the number of texts
+// noise: the noise words to ignore
+// cache: the cache of texts read before
+// anon_text: the anonymous text
+// error: where to store the largest error any distance may have, if the anonymous text is sketched
+PriorityQueue *score_shards(Options *opts, char **authors, char **paths, uint32_t texts,
+    NoiseSet *noise, Cache *cache, Text *anon_text, double *error) {
+    uint32_t workers = opts->workers < texts ? opts->workers : texts;
+    FILE **pipes = (FILE **) calloc(workers, sizeof(FILE *));
+    pid_t *pids = (pid_t *) calloc(workers, sizeof(pid_t));
+    PriorityQueue *pq = pq_create(texts);
+    *error = 0;
+    if (pipes == NULL || pids == NULL || pq == NULL) {
+        free(pipes);
+        free(pids);
+        if (pq != NULL) {
+            pq_delete(&pq);
+        }
+        return score_texts(opts, authors, paths, texts, noise, cache, anon_text, error);
+    }
+    fflush(stdout); // or the workers would write anything buffered again
+    fflush(stderr);
+    uint32_t started = 0;
+    bool failed = false; // whether any texts could not be scored
+    for (; started < workers; started++) {
+        uint32_t start = (uint64_t) texts * started / workers;
+        uint32_t end = (uint64_t) texts * (started + 1) / workers;
+        int fds[2];
+        if (pipe(fds) != 0) {
+            break;
+        }
+        pid_t pid = fork();
+        if (pid < 0) {
+            close(fds[0]);
+            close(fds[1]);
+            break;
+        }
+        if (pid == 0) {
+            stats_reset(); // the parent's counts, such as of the anonymous text, are its own
+            close(fds[0]);
+            for (uint32_t i = 0; i < started; i++) {
+                fclose(pipes[i]); // so only the parent holds the other workers' pipes
+            }
+            _exit(run_shard(opts, authors + start, paths + start, end - start, noise, cache,
+                anon_text, fds[1]));
+        }
+        close(fds[1]);
+        pids[started] = pid;
+        pipes[started] = fdopen(fds[0], "r");
+        if (pipes[started] == NULL) {
+            close(fds[0]);
+        }
+    }
+    if (started < workers) { // could not start them all, so score the rest here
+        uint32_t start = (uint64_t) texts * started / workers;
+        double bound;
+        PriorityQueue *rest = score_texts(
+            opts, authors + start, paths + start, texts - start, noise, cache, anon_text, &bound);
+        if (rest == NULL) {
+            failed = true;
+        } else {
+            *error = bound;
+            char *author;
+            double dist;
+            while (dequeue(rest, &author, &dist)) {
+                enqueue(pq, author, dist);
+            }
+            pq_delete(&rest);
+        }
+    }
+    for (uint32_t i = 0; i < started; i++) {
+        bool ok = pipes[i] != NULL && gather_shard(pipes[i], pq, error);
+        if (pipes[i] != NULL) {
+            fclose(pipes[i]);
+        }
+        int status;
+        if (waitpid(pids[i], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            ok = false;
+        }
+        if (!ok) {
+            fprintf(stderr, "Worker %" PRIu32 " failed, its texts were not scored.\n", i + 1);
+            failed = true;
+        }
+    }
+    free(pipes);
+    free(pids);
+    if (failed) {
+        pq_delete(&pq);
+    }
+    return pq;
+}
+
+// A library entry waiting to be refined.
+typedef struct {
+    double dist;
+    uint32_t index;
+} Candidate;
+
+static int compare_candidates(const void *a, const void *b) {
+    double x = ((const Candidate *) a)->dist, y = ((const Candidate *) b)->dist;
+    return (x > y) - (x < y);
+}
+
+static int compare_freqs(const void *a, const void *b) {
+    double x = ((const Term *) a)->freq, y = ((const Term *) b)->freq;
+    return (x < y) - (x > y); // most frequent first
+}
+
+// Estimates every distance from the anonymous text's most frequent words,
+// then replaces estimates with exact distances, the closest first, until the deadline.
+// The library is already loaded, so the deadline bounds only this refinement; loading
+// is not cut short, since every entry needs at least an estimate.
+// The estimates are upper bounds, so an entry that was not refined is never
+// ranked closer than it really is.
+// Returns: the number of entries with exact distances, or UINT32_MAX on failure.
+//
+// opts: the command line options
+// lib: the library
+// anon: the whole anonymous profile
+// shared: the anonymous words some library text has
+// tail: the profile_tail of the rest
+// dists: where to store the distance of every entry
+static uint32_t refine_until(
+    Options *opts, Library *lib, Profile *anon, Profile *shared, double tail, double *dists) {
+    Candidate *order = (Candidate *) malloc((lib->count + 1) * sizeof(Candidate));
+    Profile *top = profile_create(shared->size);
+    if (order == NULL || top == NULL) {
+        free(order);
+        if (top != NULL) {
+            profile_delete(&top);
+        }
+        return UINT32_MAX;
+    }
+    memcpy(top->terms, shared->terms, shared->size * sizeof(Term));
+    qsort(top->terms, top->size, sizeof(Term), compare_freqs);
+    top->size = top->size < ESTIMATE_TERMS ? top->size : ESTIMATE_TERMS;
+    profile_sort(top);
+    double norm = profile_norm(anon);
+    uint64_t mark = stats_start();
+    for (uint32_t i = 0; i < lib->count; i++) {
+        dists[i] = profile_estimate(lib->profiles[i], lib->norms[i], top, norm, opts->metric);
+        order[i] = (Candidate) { dists[i], i };
+    }
+    qsort(order, lib->count, sizeof(Candidate), compare_candidates);
+    mark = stats_stop(RANK, mark);
+    uint32_t scored = 0;
+    for (; scored < lib->count && stats_now() < opts->deadline; scored++) {
+        uint32_t i = order[scored].index;
+        dists[i] = profile_dist_tail(lib->profiles[i], shared, tail, opts->metric);
+    }
+    stats_stop(DISTANCE, mark);
+    free(order);
+    profile_delete(&top);
+    return scored;
+}
+
+// Scores the library against the anonymous text with the whole library in memory,
+// one entry per text, or per author with centroids.
+// The library's vocabulary is the union of its words, so the anonymous words that
+// no library text has are found once, and their share of every distance is summed
+// up front instead of being merged against each profile.
+// Returns: a queue of the authors by distance, or NULL on failure.
+//
+// opts: the command line options
+// authors: the author of each text
+// paths: the path of each text
+// texts: the number of texts
+// noise: the noise words to ignore
+// cache: the cache of texts read before
+// anon_text: the anonymous text
+// scored: where to store how many entries have exact distances, all of them without a deadline
+// error: where to store the largest error any distance may have, if the library is packed
+PriorityQueue *score_library(Options *opts, char **authors, char **paths, uint32_t texts,
+    NoiseSet *noise, Cache *cache, Text *anon_text, uint32_t *scored, double *error) {
+    // centroids are averaged from full profiles, so their library is packed afterwards
+    bool pack = opts->packed && !opts->centroids;
+    Library *lib
+        = library_create(authors, paths, texts, noise, cache, opts->prefetch_depth, pack);
+    if (lib == NULL || (opts->centroids && !library_centroids(lib))
+        || (opts->packed && !library_pack(lib))) {
+        fprintf(stderr, "Could not allocate memory for the library.\n");
+        if (lib != NULL) {
+            library_delete(&lib);
+        }
+        return NULL;
+    }
+    uint32_t known = vocab_size(lib->vocab); // new words get ids from here on
+    Profile *anon = text_profile(anon_text, lib->vocab);
+    PriorityQueue *pq = pq_create(lib->count);
+    double *dists = (double *) malloc((lib->count + 1) * sizeof(double));
+    if (anon == NULL || pq == NULL || dists == NULL) {
+        fprintf(stderr, "Could not allocate memory for the anonymous profile.\n");
+        if (pq != NULL) {
+            pq_delete(&pq);
+        }
+    }
+    Profile shared = { 0, NULL }; // the anonymous words some library text has
+    double tail = 0;
+    if (anon != NULL) {
+        shared = (Profile) { profile_known(anon, known), anon->terms };
+        tail = profile_tail(anon, shared.size, opts->metric);
+    }
+    *scored = lib->count;
+    *error = 0;
+    if (pq != NULL && opts->deadline != 0) {
+        *scored = refine_until(opts, lib, anon, &shared, tail, dists);
+        if (*scored == UINT32_MAX) {
+            fprintf(stderr, "Could not allocate memory for the estimates.\n");
+            pq_delete(&pq);
+        }
+    }
+    for (uint32_t i = 0; pq != NULL && i < lib->count; i++) {
+        uint64_t mark = stats_start();
+        if (lib->packed != NULL) {
+            dists[i] = packed_dist_tail(lib->packed[i], &shared, tail, opts->metric);
+            double bound = packed_error(lib->packed[i], opts->metric);
+            *error = bound > *error ? bound : *error;
+            mark = stats_stop(DISTANCE, mark);
+        } else if (opts->deadline == 0) {
+            dists[i] = profile_dist_tail(lib->profiles[i], &shared, tail, opts->metric);
+            mark = stats_stop(DISTANCE, mark);
+        }
+        enqueue(pq, lib->authors[i], dists[i]);
+        lib->authors[i] = NULL; // the queue owns it now
+        stats_stop(RANK, mark);
+    }
+    if (anon != NULL) {
+        profile_delete(&anon);
+    }
+    free(dists);
+    library_delete(&lib);
+    return pq;
+}
+
+// Prints the closest matches, emptying the queue.
+//
+// opts: the command line options
+// pq: the queue of authors by distance
+void print_matches(Options *opts, PriorityQueue *pq) {
+    char *author;
+    double dist;
+    printf("Top %" PRIu32 ", metric: %s, noise limit: %" PRIu32 "\n", opts->matches,
+        metric_names[opts->metric], opts->noiselimit);
+    uint64_t mark = stats_start();
+    for (uint32_t i = 1; i <= opts->matches && dequeue(pq, &author, &dist); i++) {
+        printf("%" PRIu32 ") %s [%17.15f]\n", i, author, dist);
+        free(author);
+    }
+    stats_stop(RANK, mark);
+    return;
+}
+
+// Computes and writes the distance matrix of the whole library.
+// Returns: the exit status.
+//
+// opts: the command line options
+// authors: the author of each text
+// paths: the path of each text
+// texts: the number of texts
+// noise: the noise words to ignore
+// cache: the cache of texts read before
+int write_matrix(
+    Options *opts, char **authors, char **paths, uint32_t texts, NoiseSet *noise, Cache *cache) {
+    Library *lib
+        = library_create(authors, paths, texts, noise, cache, opts->prefetch_depth, false);
+    if (lib == NULL || (opts->centroids && !library_centroids(lib))) {
+        fprintf(stderr, "Could not allocate memory for the library.\n");
+        if (lib != NULL) {
+            library_delete(&lib);
+        }
+        return 1;
+    }
+    uint64_t mark = stats_start();
+    double *matrix = matrix_compute(lib->profiles, lib->count, opts->metric, text_threads);
+    stats_stop(DISTANCE, mark);
+    int status = 0;
+    if (matrix == NULL) {
+        fprintf(stderr, "Could not allocate memory for the matrix.\n");
+        status = 1;
+    } else if (!matrix_write(opts->matrix_name, lib->authors, matrix, lib->count)) {
+        fprintf(stderr, "Could not write the matrix to %s.\n", opts->matrix_name);
+        status = 1;
+    }
+    free(matrix);
+    library_delete(&lib);
+    return status;
+}
+
+// Prints one stretch of windows that share a closest author.
+//
+// first: the index of the first word of the stretch
+// last: the index of the last word before the next stretch, or of the text
+// author: the closest author
+// dist: the smallest distance of any window in the stretch
+static void print_segment(uint64_t first, uint64_t last, char *author, double dist) {
+    printf("Words %" PRIu64 "-%" PRIu64 ": %s [%17.15f]\n", first, last, author, dist);
+    return;
+}
+
+// Slides a window over the anonymous text from standard input, and prints
+// the closest library text's author for each stretch of consecutive windows
+// where it stays the same. Texts of the same author count as one, so a stretch
+// only ends where the author changes, and it ends right before the first word
+// of the first window with the new author, so the stretches do not overlap.
+// Returns: the exit status.
+//
+// opts: the command line options
+// authors: the author of each text
+// paths: the path of each text
+// texts: the number of texts
+// noise: the noise words to ignore
+// cache: the cache of texts read before
+int attribute_windows(
+    Options *opts, char **authors, char **paths, uint32_t texts, NoiseSet *noise, Cache *cache) {
+    Library *lib
+        = library_create(authors, paths, texts, noise, cache, opts->prefetch_depth, false);
+    if (lib == NULL || (opts->centroids && !library_centroids(lib))) {
+        fprintf(stderr, "Could not allocate memory for the library.\n");
+        if (lib != NULL) {
+            library_delete(&lib);
+        }
+        return 1;
+    }
+    Window *w = window_create(lib, opts->window, opts->metric);
+    WordStream *ws = ws_create(stdin);
+    if (w == NULL || ws == NULL) {
+        fprintf(stderr, "Could not allocate memory for the window.\n");
+        if (w != NULL) {
+            window_delete(&w);
+        }
+        if (ws != NULL) {
+            ws_delete(&ws);
+        }
+        library_delete(&lib);
+        return 1;
+    }
+    printf("Window: %" PRIu32 " words, metric: %s, noise limit: %" PRIu32 "\n", opts->window,
+        metric_names[opts->metric], opts->noiselimit);
+    uint64_t words = 0, first = 0; // window i covers words i to i + window - 1
+    uint32_t current = UINT32_MAX;
+    double current_dist = 0;
+    char word[MAX_WORD];
+    uint64_t mark = stats_start();
+    while (ws_next(ws, word) > 0) {
+        mark = stats_stop(TOKENIZE, mark);
+        bool is_noise = ns_contains(noise, word);
+        mark = stats_stop(NOISE, mark);
+        if (is_noise) {
+            continue;
+        }
+        if (!window_push(w, word)) {
+            fprintf(stderr, "Could not allocate memory for the window.\n");
+            break;
+        }
+        words++;
+        if (!window_full(w)) {
+            continue;
+        }
+        uint64_t start = words - opts->window;
+        double dist;
+        uint32_t best = window_best(w, &dist);
+        mark = stats_stop(DISTANCE, mark);
+        if (current != UINT32_MAX && strcmp(lib->authors[best], lib->authors[current]) == 0) {
+            current_dist = dist < current_dist ? dist : current_dist;
+            continue;
+        }
+        if (current != UINT32_MAX) {
+            print_segment(first, start - 1, lib->authors[current], current_dist);
+        }
+        first = start;
+        current = best;
+        current_dist = dist;
+    }
+    stats_stop(TOKENIZE, mark);
+    if (current != UINT32_MAX) {
+        print_segment(first, words - 1, lib->authors[current], current_dist);
+    } else {
+        printf("The text is shorter than the window.\n");
+    }
+    stats_count(WORDS, words);
+    ws_delete(&ws);
+    window_delete(&w);
+    library_delete(&lib);
+    return 0;
+}
+
+// Fits the parallelism of the run under opts->mem_limit, from an estimate of the
+// memory it needs. A text is taken to need its empty tables (text_base_bytes) and
+// twice the size of its file for its words. Every worker holds the file it is
+// counting, the files it has read ahead and the text, and every thread that counts
+// part of a large text counts into empty tables of its own. Threads are given up
+// first, then reading ahead, then workers, until the estimate fits. The profiles
+// of a resident library are not part of the estimate.
+//
+// opts: the command line options, whose prefetch depth and workers may be lowered
+// paths: the path of each text
+// texts: the number of texts
+void fit_memory(Options *opts, char **paths, uint32_t texts) {
+    struct stat st;
+    uint64_t largest = 0;
+    for (uint32_t i = 0; i < texts; i++) {
+        if (stat(paths[i], &st) == 0 && (uint64_t) st.st_size > largest) {
+            largest = st.st_size;
+        }
+    }
+    uint64_t base = text_base_bytes();
+    uint64_t anon = base;
+    if (fstat(STDIN_FILENO, &st) == 0 && S_ISREG(st.st_mode)) {
+        anon += 2 * (uint64_t) st.st_size;
+    }
+    while (true) {
+        uint64_t threads = text_threads > 1 ? text_threads : 0;
+        uint64_t worker = base + 3 * largest + threads * base + opts->prefetch_depth * largest;
+        uint64_t workers = opts->workers > 1 ? opts->workers : 1;
+        if (anon + workers * worker <= opts->mem_limit) {
+            return;
+        }
+        if (text_threads > 1) {
+            text_threads--;
+        } else if (opts->prefetch_depth > 0) {
+            opts->prefetch_depth--;
+        } else if (opts->workers > 1) {
+            opts->workers--;
+        } else {
+            fprintf(stderr, "Warning: about %" PRIu64 " MB may be needed, over the limit.\n",
+                ((anon + worker) >> 20) + 1);
+            return;
+        }
+    }
+}
+
+// Prints the statistics of the run, as asked for by the options.
+//
+// opts: the command line options
+// start_time: when the run started
+void report_stats(Options *opts, uint64_t start_time) {
+    Stats stats;
+    stats_collect(&stats);
+    struct rusage usage, children;
+    getrusage(RUSAGE_SELF, &usage);
+    getrusage(RUSAGE_CHILDREN, &children); // the workers, if any
+    uint64_t peak = (uint64_t) usage.ru_maxrss * 1024; // kilobytes on Linux
+    uint64_t worker_peak = (uint64_t) children.ru_maxrss * 1024;
+    if (opts->json_name != NULL) {
+        FILE *json = strcmp(opts->json_name, "-") == 0 ? stdout : fopen(opts->json_name, "w");
+        if (json == NULL) {
+            fprintf(stderr, "Could not open %s for writing.\n", opts->json_name);
+        } else {
+            stats_print_json(json, &stats, (stats_now() - start_time) / 1e9,
+                usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6,
+                peak > worker_peak ? peak : worker_peak);
+            if (json != stdout) {
+                fclose(json);
+            }
+        }
+    }
+    if (opts->verbose) {
         printf("\n");
-        printf("Average Probes per Insertion: %f\n", insertion_probes / (double) ht_insertions);
-        printf("Average Probes per Lookup: %f\n", lookup_probes / (double) ht_lookups);
-        printf("Average Hash Table Load: %f\n", average_ht_load);
-        printf("Max Hash Table Load: %f\n", max_ht_load);
-        printf("Bloom Filter False Positive Rate: %f\n", bf_false_positives / (double) bf_lookups);
-        struct rusage usage;
-        getrusage(RUSAGE_SELF, &usage);
+        stats_print(stdout, &stats);
         int64_t sec = usage.ru_utime.tv_sec;
         int64_t ms = (usage.ru_utime.tv_usec + 500) / 1000;
         if (ms >= 1000) {
             sec++;
             ms -= 1000;
         }
+        if (text_verify) {
+            printf("Fingerprint Collisions: %" PRIu64 "\n", stats.counters[FP_COLLISIONS]);
+        }
+        printf("Peak Memory: %" PRIu64 " KB\n", peak >> 10);
+        if (opts->workers > 1) {
+            printf("Peak Worker Memory: %" PRIu64 " KB\n", worker_peak >> 10);
+        }
+        if (opts->mem_limit > 0) {
+            printf("Memory Limit: %" PRIu64 " KB, with %" PRIu32 " threads, %" PRIu32
+                   " files read ahead, %" PRIu32 " workers\n",
+                opts->mem_limit >> 10, text_threads, opts->prefetch_depth,
+                opts->workers > 1 ? opts->workers : 1);
+        }
+        if (opts->packed) {
+            printf("Packed Profile Bytes: %" PRIu64 " (%" PRIu64 " unpacked)\n",
+                stats.counters[PACKED_BYTES], stats.counters[UNPACKED_BYTES]);
+        }
         printf("Seconds taken: %" PRId64 ".%03" PRId64 "\n", sec, ms); // round to nearest ms
     }
-    return 0;
+    return;
+}
+
+int main(int argc, char *argv[]) {
+    uint64_t start_time = stats_now();
+    // defaults
+    Options opts = {
+        .db_name = "lib.db",
+        .noise_file_name = "noise.txt",
+        .matches = 5,
+        .metric = EUCLIDEAN,
+        .noiselimit = 100,
+        .prefetch_depth = 4,
+    };
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    text_threads = cpus > 0 ? cpus : 1;
+
+    // parse options
+    int option;
+    while ((option = getopt_long(argc, argv, "d:n:k:l:emcvj:t:p:C:H:B:h", long_options, NULL))
+           != -1) {
+        switch (option) {
+        case 'd': opts.db_name = optarg; break;
+        case 'n': opts.noise_file_name = optarg; break;
+        case 'k': opts.matches = strtoul(optarg, NULL, 10); break;
+        case 'l': opts.noiselimit = strtoul(optarg, NULL, 10); break;
+        case 'e': opts.metric = EUCLIDEAN; break;
+        case 'm': opts.metric = MANHATTAN; break;
+        case 'c': opts.metric = COSINE; break;
+        case 'v': opts.verbose = true; break;
+        case 'j':
+            opts.json_name = optarg;
+            stats_timing = true;
+            break;
+        case 't': text_threads = strtoul(optarg, NULL, 10); break;
+        case 'p': opts.prefetch_depth = strtoul(optarg, NULL, 10); break;
+        case 'C': opts.cache_dir = optarg; break;
+        case 'H': hash_table_size = strtoul(optarg, NULL, 10); break;
+        case 'B': bloom_filter_size = strtoul(optarg, NULL, 10); break;
+        case OPT_MATRIX: opts.matrix_name = optarg; break;
+        case OPT_SKETCH: opts.sketch = true; break;
+        case OPT_SKETCH_WIDTH: sketch_width = strtoul(optarg, NULL, 10); break;
+        case OPT_SKETCH_DEPTH: sketch_depth = strtoul(optarg, NULL, 10); break;
+        case OPT_HEAVY_HITTERS: sketch_heavy = strtoul(optarg, NULL, 10); break;
+        case OPT_FINGERPRINTS: text_fingerprints = true; break;
+        case OPT_WINDOW: opts.window = strtoul(optarg, NULL, 10); break;
+        case OPT_CENTROIDS: opts.centroids = true; break;
+        case OPT_RESIDENT: opts.resident = true; break;
+        case OPT_DEADLINE:
+            opts.deadline = start_time + (uint64_t) (strtod(optarg, NULL) * 1e6);
+            break;
+        case OPT_BIGRAMS:
+            text_fingerprints = true;
+            text_bigrams = true;
+            break;
+        case OPT_CHAR_NGRAMS:
+            text_fingerprints = true;
+            text_char_ngrams = strtoul(optarg, NULL, 10);
+            break;
+        case OPT_WORKERS: opts.workers = strtoul(optarg, NULL, 10); break;
+        case OPT_PACKED: opts.packed = true; break;
+        case OPT_MEM_LIMIT: opts.mem_limit = strtod(optarg, NULL) * (1 << 20); break;
+        case OPT_VERIFY_FINGERPRINTS:
+            text_fingerprints = true;
+            text_verify = true;
+            break;
+        case 'h':
+        default: usage(argv[0]); break;
+        }
+    }
+    if (opts.sketch && text_fingerprints) {
+        fprintf(stderr, "--sketch cannot be combined with fingerprints.\n");
+        return 1;
+    }
+    if (opts.packed && opts.deadline != 0) {
+        fprintf(stderr, "--packed cannot be combined with --deadline.\n");
+        return 1;
+    }
+    // these modes compare profiles of exact word counts, without sketches or other features
+    if ((opts.sketch || text_bigrams || text_char_ngrams > 0)
+        && (opts.matrix_name != NULL || opts.window > 0 || opts.centroids || opts.resident
+            || opts.deadline != 0 || opts.packed)) {
+        fprintf(stderr, "--sketch, --bigrams and --char-ngrams cannot be combined with --matrix, "
+                        "--window, --centroids, --resident, --deadline or --packed.\n");
+        return 1;
+    }
+    // windows look the words of standard input up in the library's vocabulary as strings
+    if (text_fingerprints && opts.window > 0) {
+        fprintf(stderr,
+            "--fingerprints and --verify-fingerprints cannot be combined with --window.\n");
+        return 1;
+    }
+
+    FILE *database = open_read(opts.db_name, argv[0]);
+    FILE *noise_file = open_read(opts.noise_file_name, argv[0]);
+
+    // create noise
+    NoiseSet *noise = ns_create(noise_file, opts.noiselimit);
+    fclose(noise_file);
+    if (noise == NULL) {
+        fprintf(stderr, "Could not allocate memory for noise.\n");
+        return 1;
+    }
+
+    // read the whole database up front, so the files can be read ahead
+    char **authors, **paths;
+    int64_t texts = read_database(database, opts.db_name, &authors, &paths);
+    fclose(database);
+    if (texts < 0) {
+        ns_delete(&noise);
+        return 1;
+    }
+
+    if (opts.mem_limit > 0) {
+        fit_memory(&opts, paths, texts);
+    }
+
+    Cache *cache = cache_create(opts.cache_dir, noise);
+    if (cache == NULL) {
+        fprintf(stderr, "Could not allocate memory for the cache.\n");
+        free_entries(authors, paths, texts);
+        ns_delete(&noise);
+        return 1;
+    }
+    int status = 0;
+    if (opts.matrix_name != NULL) {
+        status = write_matrix(&opts, authors, paths, texts, noise, cache);
+    } else if (opts.window > 0) {
+        status = attribute_windows(&opts, authors, paths, texts, noise, cache);
+    } else if (opts.centroids || opts.resident || opts.deadline != 0 || opts.packed) {
+        Text *anon_text = text_create(stdin, noise);
+        PriorityQueue *pq = NULL;
+        uint32_t scored;
+        double error;
+        if (anon_text != NULL) {
+            pq = score_library(
+                &opts, authors, paths, texts, noise, cache, anon_text, &scored, &error);
+            text_delete(&anon_text);
+        }
+        if (pq == NULL) {
+            status = 1;
+        } else {
+            uint32_t entries = pq_size(pq);
+            print_matches(&opts, pq);
+            if (opts.deadline != 0) {
+                printf("Fully scored: %" PRIu32 " of %" PRIu32 "\n", scored, entries);
+            }
+            if (opts.packed) {
+                printf("Packing error bound: %.9f\n", error);
+            }
+            pq_delete(&pq);
+        }
+    } else {
+        Text *anon_text
+            = opts.sketch ? text_create_sketch(stdin, noise) : text_create(stdin, noise);
+        if (anon_text == NULL) {
+            status = 1;
+        } else {
+            double error;
+            PriorityQueue *pq
+                = opts.workers > 1
+                      ? score_shards(&opts, authors, paths, texts, noise, cache, anon_text, &error)
+                      : score_texts(&opts, authors, paths, texts, noise, cache, anon_text, &error);
+            double delta = text_delta(anon_text);
+            text_delete(&anon_text);
+            if (pq == NULL) {
+                status = 1;
+            } else {
+                print_matches(&opts, pq);
+                if (opts.sketch) {
+                    printf("Sketch error bound: %.6f (each estimate within it with probability "
+                           "%.6f)\n",
+                        error, 1 - delta);
+                }
+                pq_delete(&pq);
+            }
+        }
+    }
+    cache_delete(&cache);
+    free_entries(authors, paths, texts);
+    ns_delete(&noise);
+
+    report_stats(&opts, start_time);
+    return status;
 }
@@ -0,0 +1,218 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "library.h"
+#include "prefetch.h"
+#include "stats.h"
+#include "text.h"
+
+// Reads every text of a database and keeps it as a profile.
+// Only one full text is in memory at a time. Texts that cannot be read are left out.
+// Returns: the library, or NULL on failure.
+//
+// authors: the author of each text
+// paths: the path of each text
+// count: the number of texts
+// noise: the noise words to ignore
+// cache: the cache of texts read before
+// depth: how many files to read ahead, 0 for none
+// pack: whether to pack every profile as soon as it is made, see library_pack
+Library *library_create(char **authors, char **paths, uint32_t count, NoiseSet *noise,
+    Cache *cache, uint32_t depth, bool pack) {
+    Library *lib = (Library *) malloc(sizeof(Library));
+    if (lib == NULL) {
+        return NULL;
+    }
+    lib->count = 0;
+    lib->authors = (char **) calloc(count, sizeof(char *));
+    lib->profiles = (Profile **) calloc(count, sizeof(Profile *));
+    lib->norms = (double *) calloc(count + 1, sizeof(double));
+    lib->packed = pack ? (PackedProfile **) calloc(count + 1, sizeof(PackedProfile *)) : NULL;
+    lib->vocab = vocab_create();
+    if (lib->authors == NULL || lib->profiles == NULL || lib->norms == NULL
+        || lib->vocab == NULL || (pack && lib->packed == NULL)) {
+        library_delete(&lib);
+        return NULL;
+    }
+    Text *scratch = text_create_scratch(); // reset after every text instead of freed
+    if (scratch == NULL) {
+        library_delete(&lib);
+        return NULL;
+    }
+    Prefetcher *pf = pf_create(paths, count, depth); // its buffers are reused the same way
+    if (pf == NULL) {
+        text_delete(&scratch);
+        library_delete(&lib);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        size_t length;
+        char *data = pf_take(pf, paths[i], &length);
+        if (data == NULL) {
+            fprintf(stderr, "File %s could not be opened.\n", paths[i]);
+            continue;
+        }
+        Digest key = cache_key(cache, data, length);
+        Text *text = cache_read(cache, key);
+        if (text == NULL) {
+            text = text_fill_buffer(scratch, data, length, noise);
+            if (text != NULL) {
+                cache_write(cache, key, text);
+            }
+        }
+        if (text == NULL) {
+            continue;
+        }
+        stats_count(TEXTS, 1);
+        Profile *p = text_profile(text, lib->vocab);
+        if (text == scratch) {
+            text_reset(scratch);
+        } else {
+            text_delete(&text);
+        }
+        if (p == NULL) {
+            fprintf(stderr, "Could not allocate memory for the profile of %s.\n", paths[i]);
+            continue;
+        }
+        if (pack) {
+            lib->packed[lib->count] = profile_pack(p);
+            profile_delete(&p);
+            if (lib->packed[lib->count] == NULL) {
+                fprintf(stderr, "Could not allocate memory for the profile of %s.\n", paths[i]);
+                continue;
+            }
+        } else {
+            lib->norms[lib->count] = profile_norm(p);
+        }
+        lib->authors[lib->count] = strdup(authors[i]);
+        lib->profiles[lib->count++] = p;
+    }
+    text_delete(&scratch);
+    pf_delete(&pf);
+    return lib;
+}
+
+// Replaces the texts of every author with one centroid profile, the average of
+// their profiles, so the library has one entry per author in order of first appearance.
+// Returns: whether it succeeded, the library is unchanged otherwise.
+// A packed library cannot be averaged.
+//
+// lib: the library
+bool library_centroids(Library *lib) {
+    if (lib->packed != NULL) {
+        return false;
+    }
+    Vocab *names = vocab_create(); // author name to dense group id
+    uint32_t *group = (uint32_t *) malloc((lib->count + 1) * sizeof(uint32_t));
+    uint32_t *start = (uint32_t *) calloc(lib->count + 2, sizeof(uint32_t));
+    Profile **members = (Profile **) malloc((lib->count + 1) * sizeof(Profile *));
+    Profile **centroids = (Profile **) calloc(lib->count + 1, sizeof(Profile *));
+    char **authors = (char **) calloc(lib->count + 1, sizeof(char *));
+    bool ok = names != NULL && group != NULL && start != NULL && members != NULL
+              && centroids != NULL && authors != NULL;
+    for (uint32_t i = 0; ok && i < lib->count; i++) {
+        group[i] = vocab_id(names, lib->authors[i]);
+        ok = group[i] != VOCAB_NONE;
+    }
+    uint32_t groups = ok ? vocab_size(names) : 0;
+    if (ok) { // lay the profiles out group by group, members of g from start[g] to start[g + 1]
+        for (uint32_t i = 0; i < lib->count; i++) {
+            start[group[i] + 2]++;
+        }
+        for (uint32_t g = 2; g <= groups; g++) {
+            start[g] += start[g - 1];
+        }
+        for (uint32_t i = 0; i < lib->count; i++) {
+            members[start[group[i] + 1]++] = lib->profiles[i];
+        }
+    }
+    for (uint32_t g = 0; ok && g < groups; g++) {
+        centroids[g] = profile_centroid(members + start[g], start[g + 1] - start[g]);
+        authors[g] = strdup(vocab_word(names, g));
+        ok = centroids[g] != NULL && authors[g] != NULL;
+    }
+    // whichever set is not kept is freed
+    Profile **old_profiles = ok ? lib->profiles : centroids;
+    char **old_authors = ok ? lib->authors : authors;
+    uint32_t old_count = ok ? lib->count : groups;
+    for (uint32_t i = 0; i < old_count; i++) {
+        free(old_authors[i]);
+        if (old_profiles[i] != NULL) {
+            profile_delete(&old_profiles[i]);
+        }
+    }
+    free(old_profiles);
+    free(old_authors);
+    if (ok) {
+        lib->profiles = centroids;
+        lib->authors = authors;
+        lib->count = groups;
+        for (uint32_t g = 0; g < groups; g++) {
+            lib->norms[g] = profile_norm(centroids[g]);
+        }
+    }
+    if (names != NULL) {
+        vocab_delete(&names);
+    }
+    free(group);
+    free(start);
+    free(members);
+    return ok;
+}
+
+// Packs every profile of the library, which keeps it in a fraction of the memory
+// at the cost of a small error in every distance, see packed_error.
+// Distances are then taken with packed_dist_tail, and the norms are no longer kept.
+// Returns: whether it succeeded, the library is unchanged otherwise.
+//
+// lib: the library
+bool library_pack(Library *lib) {
+    if (lib->packed != NULL) {
+        return true;
+    }
+    PackedProfile **packed = (PackedProfile **) calloc(lib->count + 1, sizeof(PackedProfile *));
+    bool ok = packed != NULL;
+    for (uint32_t i = 0; ok && i < lib->count; i++) {
+        packed[i] = profile_pack(lib->profiles[i]);
+        ok = packed[i] != NULL;
+    }
+    for (uint32_t i = 0; i < lib->count && packed != NULL; i++) {
+        if (ok) {
+            profile_delete(&lib->profiles[i]);
+        } else if (packed[i] != NULL) {
+            packed_delete(&packed[i]);
+        }
+    }
+    if (ok) {
+        lib->packed = packed;
+    } else {
+        free(packed);
+    }
+    return ok;
+}
+
+// Deletes the library.
+//
+// lib: a pointer to the address of the library
+void library_delete(Library **lib) {
+    for (uint32_t i = 0; i < (*lib)->count; i++) {
+        free((*lib)->authors[i]);
+        if ((*lib)->profiles[i] != NULL) {
+            profile_delete(&(*lib)->profiles[i]);
+        }
+        if ((*lib)->packed != NULL) {
+            packed_delete(&(*lib)->packed[i]);
+        }
+    }
+    free((*lib)->packed);
+    free((*lib)->authors);
+    free((*lib)->profiles);
+    free((*lib)->norms);
+    if ((*lib)->vocab != NULL) {
+        vocab_delete(&(*lib)->vocab);
+    }
+    free(*lib);
+    *lib = NULL;
+    return;
+}
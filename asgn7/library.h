@@ -0,0 +1,28 @@
+#pragma once
+
+#include "cache.h"
+#include "ns.h"
+#include "profile.h"
+#include "vocab.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Every readable text of a database, resident as profiles over one vocabulary.
+typedef struct {
+    uint32_t count;
+    char **authors;
+    Profile **profiles; // NULL entries once packed
+    PackedProfile **packed; // the packed profiles, or NULL if the library is not packed
+    double *norms; // profile_norm of every profile
+    Vocab *vocab;
+} Library;
+
+Library *library_create(char **authors, char **paths, uint32_t count, NoiseSet *noise,
+    Cache *cache, uint32_t depth, bool pack);
+
+bool library_centroids(Library *lib);
+
+bool library_pack(Library *lib);
+
+void library_delete(Library **lib);
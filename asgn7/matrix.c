@@ -0,0 +1,151 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "matrix.h"
+#include "stats.h"
+
+// Side length of a tile of the matrix. The profiles of one tile's rows and
+// columns are compared against each other many times, so they stay in cache.
+#define TILE 16
+
+// Shared by the threads filling in a matrix.
+typedef struct {
+    Profile **profiles;
+    uint32_t n;
+    Metric metric;
+    double *matrix;
+    uint32_t tiles; // tiles per side
+    atomic_uint next; // next tile to hand out, counting only the upper triangle
+} Job;
+
+// Fills in one tile of the upper triangle, and its mirror image below the diagonal.
+//
+// job: the matrix being computed
+// row: the tile's row, in tiles
+// col: the tile's column, in tiles, at least row
+static void fill_tile(Job *job, uint32_t row, uint32_t col) {
+    uint32_t n = job->n;
+    uint32_t i_end = (row + 1) * TILE < n ? (row + 1) * TILE : n;
+    uint32_t j_end = (col + 1) * TILE < n ? (col + 1) * TILE : n;
+    for (uint32_t i = row * TILE; i < i_end; i++) {
+        // every distance is symmetric, so only j >= i is computed
+        for (uint32_t j = row == col ? i : col * TILE; j < j_end; j++) {
+            double d = profile_dist(job->profiles[i], job->profiles[j], job->metric);
+            job->matrix[(size_t) i * n + j] = d;
+            job->matrix[(size_t) j * n + i] = d;
+        }
+    }
+    return;
+}
+
+// Thread entry point: fills in tiles until none are left.
+//
+// arg: the job
+static void *work(void *arg) {
+    Job *job = (Job *) arg;
+    uint32_t total = job->tiles * (job->tiles + 1) / 2;
+    uint32_t t;
+    while ((t = atomic_fetch_add(&job->next, 1)) < total) {
+        // turn the index back into a row and column of the upper triangle
+        uint32_t row = 0, row_length = job->tiles;
+        while (t >= row_length) {
+            t -= row_length--;
+            row++;
+        }
+        fill_tile(job, row, row + t);
+    }
+    stats_flush();
+    return NULL;
+}
+
+// Computes the distance between every pair of profiles.
+// Returns: the n by n matrix in row-major order, or NULL on failure.
+//
+// profiles: the profiles to compare
+// n: the number of profiles
+// metric: the algorithm to use for the calculations
+// threads: the number of threads to use
+double *matrix_compute(Profile **profiles, uint32_t n, Metric metric, uint32_t threads) {
+    double *matrix = (double *) malloc(((size_t) n * n > 0 ? (size_t) n * n : 1) * sizeof(double));
+    pthread_t *workers = (pthread_t *) calloc(threads > 0 ? threads : 1, sizeof(pthread_t));
+    if (matrix == NULL || workers == NULL) {
+        free(matrix);
+        free(workers);
+        return NULL;
+    }
+    Job job = { .profiles = profiles, .n = n, .metric = metric, .matrix = matrix };
+    job.tiles = (n + TILE - 1) / TILE;
+    atomic_init(&job.next, 0);
+    uint32_t started = 0;
+    while (started + 1 < threads && pthread_create(&workers[started], NULL, work, &job) == 0) {
+        started++;
+    }
+    work(&job); // this thread helps too
+    for (uint32_t i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+    return matrix;
+}
+
+// Returns: whether the path ends with the suffix.
+static bool ends_with(char *path, char *suffix) {
+    size_t p = strlen(path), s = strlen(suffix);
+    return p >= s && strcmp(path + p - s, suffix) == 0;
+}
+
+// Writes a name as a quoted CSV field.
+//
+// outfile: the file to write to
+// name: the name to write
+static void write_name(FILE *outfile, char *name) {
+    fputc('"', outfile);
+    for (char *c = name; *c != '\0'; c++) {
+        if (*c == '"') {
+            fputc('"', outfile); // quotes are escaped by doubling
+        }
+        fputc(*c, outfile);
+    }
+    fputc('"', outfile);
+    return;
+}
+
+// Writes a distance matrix. Paths ending in .bin get the compact binary form:
+// n as a 32-bit integer followed by the n * n native-endian doubles in row-major order.
+// Anything else gets CSV with the names as the first row and column.
+// Returns: whether the whole matrix was written.
+//
+// path: the file to write to
+// names: the name of each row and column
+// matrix: the matrix, as returned by matrix_compute
+// n: the number of rows
+bool matrix_write(char *path, char **names, double *matrix, uint32_t n) {
+    bool binary = ends_with(path, ".bin");
+    FILE *outfile = fopen(path, binary ? "wb" : "w");
+    if (outfile == NULL) {
+        return false;
+    }
+    bool ok = true;
+    if (binary) {
+        ok = fwrite(&n, sizeof(n), 1, outfile) == 1
+             && fwrite(matrix, sizeof(double), (size_t) n * n, outfile) == (size_t) n * n;
+    } else {
+        fprintf(outfile, "author");
+        for (uint32_t j = 0; j < n; j++) {
+            fputc(',', outfile);
+            write_name(outfile, names[j]);
+        }
+        fputc('\n', outfile);
+        for (uint32_t i = 0; i < n; i++) {
+            write_name(outfile, names[i]);
+            for (uint32_t j = 0; j < n; j++) {
+                fprintf(outfile, ",%.15f", matrix[(size_t) i * n + j]);
+            }
+            fputc('\n', outfile);
+        }
+    }
+    return fclose(outfile) == 0 && ok;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "metric.h"
+#include "profile.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+double *matrix_compute(Profile **profiles, uint32_t n, Metric metric, uint32_t threads);
+
+bool matrix_write(char *path, char **names, double *matrix, uint32_t n);
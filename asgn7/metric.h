@@ -1,7 +1,25 @@
 #pragma once
 
+#include <math.h>
+#include <stdio.h>
+
 typedef enum { EUCLIDEAN, MANHATTAN, COSINE } Metric;
 
 static const char *metric_names[] = { [EUCLIDEAN] = "Euclidean distance",
     [MANHATTAN] = "Manhattan distance",
     [COSINE] = "Cosine distance" };
+
+// Calculates the distance between two words' frequencies, before the metric's final step.
+// Returns: the distance, depending on the metric used.
+//
+// f1: the first value
+// f2: the second value
+// metric: the distance algorithm to use for calculations
+static inline double freq_dist(double f1, double f2, Metric metric) {
+    switch (metric) {
+    case MANHATTAN: return fabs(f1 - f2);
+    case EUCLIDEAN: return (f1 - f2) * (f1 - f2);
+    case COSINE: return f1 * f2;
+    default: fprintf(stderr, "Unknown Metric used.\n"); return 0;
+    }
+}
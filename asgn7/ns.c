@@ -0,0 +1,154 @@
+#include <inttypes.h>
+#include <regex.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "fnv.h"
+#include "ns.h"
+#include "parser.h"
+
+// The noise list is tiny and fixed once loaded, so instead of a full
+// hash table and Bloom filter it is compiled into a small open-addressed
+// table, kept at most half full so that a miss usually ends on the first
+// empty slot. Each slot keeps the full 64-bit hash so that almost every
+// non-noise word is rejected without touching the string.
+typedef struct Slot {
+    uint64_t hash;
+    char *word;
+} Slot;
+
+struct NoiseSet {
+    uint32_t size; // number of words stored
+    uint32_t mask; // table size - 1, table size is a power of 2
+    Slot *slots;
+};
+
+// Finds the slot the word belongs in, either the one holding it or the first empty one.
+// Returns: a pointer to the slot.
+//
+// ns: the set to search
+// word: the word to look for
+// h: the hash of the word
+static Slot *find_slot(NoiseSet *ns, char *word, uint64_t h) {
+    uint32_t index = h & ns->mask;
+    while (ns->slots[index].word != NULL) {
+        if (ns->slots[index].hash == h && strcmp(ns->slots[index].word, word) == 0) {
+            break;
+        }
+        index = (index + 1) & ns->mask;
+    }
+    return &ns->slots[index];
+}
+
+// Creates a noise set by reading up to limit words from the given file.
+// Words are lowercased the same way texts are.
+// Returns: a pointer to the set, or NULL on failure.
+//
+// infile: the file to read the noise words from
+// limit: the number of words to read
+NoiseSet *ns_create(FILE *infile, uint32_t limit) {
+    NoiseSet *ns = (NoiseSet *) malloc(sizeof(NoiseSet));
+    if (ns == NULL) {
+        return NULL;
+    }
+    uint32_t capacity = 16;
+    while (capacity < 2 * (uint64_t) limit && capacity < (1u << 31)) {
+        capacity <<= 1;
+    }
+    ns->size = 0;
+    ns->mask = capacity - 1;
+    ns->slots = (Slot *) calloc(capacity, sizeof(Slot));
+    if (ns->slots == NULL) {
+        free(ns);
+        return NULL;
+    }
+    regex_t regex;
+    if (regcomp(&regex, WORD_REGEX, REG_EXTENDED)) {
+        fprintf(stderr, "Regex could not compile.\n");
+        ns_delete(&ns);
+        return NULL;
+    }
+    char *word;
+    for (uint32_t read = 0; read < limit && (word = next_word(infile, &regex)) != NULL; read++) {
+        for (char *c = word; *c != '\0'; c++) {
+            *c = tolower(*c);
+        }
+        uint64_t h = fnv1a(word);
+        Slot *s = find_slot(ns, word, h);
+        if (s->word == NULL) { // duplicates only count towards the limit
+            s->hash = h;
+            s->word = strdup(word);
+            ns->size++;
+        }
+    }
+    regfree(&regex);
+    return ns;
+}
+
+// Deletes the given noise set.
+//
+// ns: a pointer to the address of the set to delete
+void ns_delete(NoiseSet **ns) {
+    for (uint32_t i = 0; i <= (*ns)->mask; i++) {
+        free((*ns)->slots[i].word);
+    }
+    free((*ns)->slots);
+    free(*ns);
+    *ns = NULL;
+    return;
+}
+
+// Returns the number of distinct words in the set.
+//
+// ns: the set to get the size of
+uint32_t ns_size(NoiseSet *ns) {
+    return ns->size;
+}
+
+// Returns whether or not the word is a noise word.
+// A NULL set contains nothing.
+//
+// ns: the set to check
+// word: the lowercased word to look for
+bool ns_contains(NoiseSet *ns, char *word) {
+    if (ns == NULL) {
+        return false;
+    }
+    return find_slot(ns, word, fnv1a(word))->word != NULL;
+}
+
+// Returns a 64-bit fingerprint of the set's words, independent of the order they were read in.
+// Anything derived from text with this noise filtered out can be keyed with it.
+//
+// ns: the set to fingerprint, NULL for no noise
+uint64_t ns_digest(NoiseSet *ns) {
+    if (ns == NULL) {
+        return 0;
+    }
+    uint64_t sum = ns->size;
+    for (uint32_t i = 0; i <= ns->mask; i++) {
+        if (ns->slots[i].word != NULL) {
+            // multiply before summing so that sets differing by a pair of
+            // hashes with the same sum do not collide
+            uint64_t h = ns->slots[i].hash;
+            sum += (h ^ (h >> 29)) * 0xbf58476d1ce4e5b9;
+        }
+    }
+    return sum;
+}
+
+// Debug function to print the noise set.
+//
+// ns: the set to print
+void ns_print(NoiseSet *ns) {
+    printf("Size: %" PRIu32 "\n", ns->size);
+    for (uint32_t i = 0; i <= ns->mask; i++) {
+        if (ns->slots[i].word != NULL) {
+            printf("%s ", ns->slots[i].word);
+        }
+    }
+    printf("\n");
+    return;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct NoiseSet NoiseSet;
+
+NoiseSet *ns_create(FILE *infile, uint32_t limit);
+
+void ns_delete(NoiseSet **ns);
+
+uint32_t ns_size(NoiseSet *ns);
+
+bool ns_contains(NoiseSet *ns, char *word);
+
+uint64_t ns_digest(NoiseSet *ns);
+
+void ns_print(NoiseSet *ns);
@@ -1,11 +1,15 @@
 #include "parser.h"
 #include <regex.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #define BLOCK 4096
 
+// Bytes read from a stream at a time.
+#define STREAM_BLOCK (1 << 20)
+
 static inline int min(int x, int y) {
     return x < y ? x : y;
 }
@@ -65,3 +69,227 @@ char *next_word(FILE *infile, regex_t *word_regex) {
     index = (index + 1) % count;
     return word;
 }
+
+static inline bool is_letter(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+// Apostrophes and hyphens may join letters inside a word.
+static inline bool is_joiner(char c) {
+    return c == '\'' || c == '-';
+}
+
+// The input is classified this many bytes at a time, one bit per byte.
+#define LANES 32
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+
+// Sets every byte of a vector of 16 that is a letter to 0xff.
+// Folding in 0x20 lowercases letters, and moving 'a' to -128 lets one signed
+// comparison check both ends of the range, so there are no branches per byte.
+static inline __m128i letters16(__m128i v) {
+    __m128i x = _mm_add_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)), _mm_set1_epi8((char) (0x80 - 'a')));
+    return _mm_cmplt_epi8(x, _mm_set1_epi8(-128 + 26));
+}
+
+// Sets every byte of a vector of 16 that is a joiner to 0xff.
+static inline __m128i joiners16(__m128i v) {
+    return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\'')), _mm_cmpeq_epi8(v, _mm_set1_epi8('-')));
+}
+
+// Classifies LANES bytes: bit i of the letters is set if p[i] is a letter,
+// and of the joiners if it is an apostrophe or hyphen.
+//
+// p: the bytes, at least LANES of them
+// letters: where to store the letter mask
+// joiners: where to store the joiner mask, or NULL
+static inline void classify(const char *p, uint32_t *letters, uint32_t *joiners) {
+    __m128i lo = _mm_loadu_si128((const __m128i *) p);
+    __m128i hi = _mm_loadu_si128((const __m128i *) (p + 16));
+    *letters = (uint32_t) _mm_movemask_epi8(letters16(lo))
+               | (uint32_t) _mm_movemask_epi8(letters16(hi)) << 16;
+    if (joiners != NULL) {
+        *joiners = (uint32_t) _mm_movemask_epi8(joiners16(lo))
+                   | (uint32_t) _mm_movemask_epi8(joiners16(hi)) << 16;
+    }
+}
+
+// Copies LANES bytes with 0x20 folded into each, which lowercases letters
+// and leaves apostrophes and hyphens as they are.
+//
+// out: where to copy to, room for LANES bytes
+// p: the bytes to copy
+static inline void fold(char *out, const char *p) {
+    __m128i case_bit = _mm_set1_epi8(0x20);
+    __m128i lo = _mm_loadu_si128((const __m128i *) p);
+    __m128i hi = _mm_loadu_si128((const __m128i *) (p + 16));
+    _mm_storeu_si128((__m128i *) out, _mm_or_si128(lo, case_bit));
+    _mm_storeu_si128((__m128i *) (out + 16), _mm_or_si128(hi, case_bit));
+}
+#else
+static inline void classify(const char *p, uint32_t *letters, uint32_t *joiners) {
+    uint32_t l = 0, j = 0;
+    for (int i = 0; i < LANES; i++) {
+        l |= (uint32_t) is_letter(p[i]) << i;
+        j |= (uint32_t) is_joiner(p[i]) << i;
+    }
+    *letters = l;
+    if (joiners != NULL) {
+        *joiners = j;
+    }
+}
+
+static inline void fold(char *out, const char *p) {
+    for (int i = 0; i < LANES; i++) {
+        out[i] = p[i] | 0x20;
+    }
+}
+#endif
+
+// Words are found a block of LANES bytes at a time: one mask marks the letters,
+// another the joiners, and the word ends at the first byte that is neither a letter
+// nor a joiner followed by a letter. Only the last few bytes of the buffer,
+// where a whole block cannot be read, are looked at one at a time.
+uint32_t scan_word(char **cursor, char *end, char *word) {
+    char *p = *cursor;
+    uint32_t letters, joiners;
+    while (p < end) { // skip to the first letter
+        if (end - p >= LANES) {
+            classify(p, &letters, NULL);
+            if (letters == 0) {
+                p += LANES;
+                continue;
+            }
+            p += __builtin_ctz(letters);
+            break;
+        }
+        if (is_letter(*p)) {
+            break;
+        }
+        p++;
+    }
+    uint32_t length = 0;
+    while (p < end) {
+        if (end - p > LANES) { // the byte after the block decides a joiner at its end
+            classify(p, &letters, &joiners);
+            uint32_t next = letters >> 1 | (uint32_t) is_letter(p[LANES]) << (LANES - 1);
+            uint32_t stop = ~(letters | (joiners & next));
+            uint32_t n = stop != 0 ? (uint32_t) __builtin_ctz(stop) : LANES;
+            if (length + LANES < MAX_WORD) {
+                fold(word + length, p); // bytes past the word are overwritten or cut off
+                length += n;
+            } else {
+                for (uint32_t i = 0; i < n && length < MAX_WORD - 1; i++) {
+                    word[length++] = p[i] | 0x20;
+                }
+            }
+            p += n;
+            if (stop != 0) {
+                break;
+            }
+            continue;
+        }
+        if (is_letter(*p)) {
+            if (length < MAX_WORD - 1) {
+                word[length++] = *p | 0x20; // ASCII lowercase
+            }
+        } else if (!(is_joiner(*p) && p + 1 < end && is_letter(p[1]))) {
+            break; // a joiner only counts if a letter follows it
+        } else if (length < MAX_WORD - 1) {
+            word[length++] = *p;
+        }
+        p++;
+    }
+    word[length] = '\0';
+    *cursor = p;
+    return length;
+}
+
+char *word_boundary(char *p, char *end) {
+    while (p < end && (is_letter(*p) || is_joiner(*p))) {
+        p++;
+    }
+    return p;
+}
+
+char *last_boundary(char *start, char *end) {
+    char *p = end;
+    while (p > start && (is_letter(p[-1]) || is_joiner(p[-1]))) {
+        p--;
+    }
+    return p > start ? p - 1 : start;
+}
+
+// The bytes read so far are scanned up to the last boundary in them, and the
+// rest, the start of a word that may go on in the next block, is carried over
+// to the front of the buffer before the next read. The buffer only grows
+// if a single block has no boundary at all.
+struct WordStream {
+    FILE *infile;
+    char *buffer;
+    size_t capacity;
+    char *cursor; // next byte to scan
+    char *cut; // end of the bytes that can be scanned
+    char *end; // end of the bytes read
+    bool eof;
+};
+
+WordStream *ws_create(FILE *infile) {
+    WordStream *ws = (WordStream *) malloc(sizeof(WordStream));
+    if (ws == NULL) {
+        return NULL;
+    }
+    ws->infile = infile;
+    ws->capacity = STREAM_BLOCK;
+    ws->buffer = (char *) malloc(ws->capacity);
+    if (ws->buffer == NULL) {
+        free(ws);
+        return NULL;
+    }
+    ws->cursor = ws->cut = ws->end = ws->buffer;
+    ws->eof = false;
+    return ws;
+}
+
+void ws_delete(WordStream **ws) {
+    free((*ws)->buffer);
+    free(*ws);
+    *ws = NULL;
+    return;
+}
+
+// Carries the unscanned bytes to the front of the buffer and reads the next block.
+// Returns: whether there was room to read into.
+//
+// ws: the stream
+static bool refill(WordStream *ws) {
+    size_t carried = ws->end - ws->cut;
+    memmove(ws->buffer, ws->cut, carried);
+    if (ws->capacity - carried < STREAM_BLOCK) {
+        char *buffer = (char *) realloc(ws->buffer, 2 * ws->capacity);
+        if (buffer == NULL) {
+            return false;
+        }
+        ws->buffer = buffer;
+        ws->capacity *= 2;
+    }
+    size_t n = fread(ws->buffer + carried, 1, STREAM_BLOCK, ws->infile);
+    ws->eof = n < STREAM_BLOCK;
+    ws->cursor = ws->buffer;
+    ws->end = ws->buffer + carried + n;
+    ws->cut = ws->eof ? ws->end : last_boundary(ws->buffer, ws->end);
+    return true;
+}
+
+uint32_t ws_next(WordStream *ws, char *word) {
+    while (true) {
+        uint32_t length = scan_word(&ws->cursor, ws->cut, word);
+        if (length > 0) {
+            return length;
+        }
+        if (ws->eof || !refill(ws)) {
+            return 0;
+        }
+    }
+}
@@ -1,8 +1,13 @@
 #pragma once
 
 #include <regex.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 
+// The regular expression for a word: letters, optionally joined by single apostrophes or hyphens.
+#define WORD_REGEX "[a-zA-Z]+([a-zA-Z'-][a-zA-Z]+)*"
+
 //
 // Returns the next word that matches the specified regular expression.
 // Words are buffered and returned as they are read from the input file.
@@ -12,3 +17,65 @@
 // returns:     The next word if it exists, a null pointer otherwise.
 //
 char *next_word(FILE *infile, regex_t *word_regex);
+
+// The longest word scan_word will copy out; longer words are cut short.
+#define MAX_WORD 4096
+
+//
+// Returns the next word in an in-memory buffer, lowercased.
+// Finds the same words as WORD_REGEX, without going through the regex engine.
+//
+// cursor:      Where to start looking, advanced past the returned word.
+// end:         The end of the buffer.
+// word:        Where to copy the word to, at least MAX_WORD bytes.
+// returns:     The length of the word, or 0 if there are no more words.
+//
+uint32_t scan_word(char **cursor, char *end, char *word);
+
+//
+// Returns the first position at or after p that no word can span,
+// so a buffer split there is tokenized the same as the whole.
+//
+// p:           Where to start looking.
+// end:         The end of the buffer.
+// returns:     The position, or end if there is none.
+//
+char *word_boundary(char *p, char *end);
+
+//
+// Returns the last position before end that no word can span,
+// so everything before it can be tokenized without the bytes after end.
+//
+// start:       The start of the buffer.
+// end:         The end of the buffer.
+// returns:     The position, or start if there is none.
+//
+char *last_boundary(char *start, char *end);
+
+// Words read from a stream a large block at a time, for input that cannot be mapped.
+typedef struct WordStream WordStream;
+
+//
+// Creates a word stream over a file.
+//
+// infile:      The file to read from, from its current position.
+// returns:     The stream, or a null pointer on failure.
+//
+WordStream *ws_create(FILE *infile);
+
+//
+// Deletes a word stream. The file is left open.
+//
+// ws:          A pointer to the address of the stream.
+//
+void ws_delete(WordStream **ws);
+
+//
+// Returns the next word of the stream, lowercased. The words are exactly those
+// scan_word finds in the whole contents, wherever the blocks were cut.
+//
+// ws:          The stream.
+// word:        Where to copy the word to, at least MAX_WORD bytes.
+// returns:     The length of the word, or 0 if there are no more words.
+//
+uint32_t ws_next(WordStream *ws, char *word);
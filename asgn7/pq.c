@@ -11,7 +11,8 @@ typedef struct Entry {
 struct PriorityQueue {
     uint32_t size;
     uint32_t capacity;
-    Entry **entries;
+    Entry **entries; // the heap, and past its end the entries not in use
+    Entry *pool; // every entry, so that adding to the queue allocates nothing
 };
 
 // Creates a priority queue with the specified capacity.
@@ -26,10 +27,16 @@ PriorityQueue *pq_create(uint32_t capacity) {
     pq->size = 0;
     pq->capacity = capacity;
     pq->entries = (Entry **) calloc(capacity, sizeof(Entry *));
-    if (pq->entries == NULL) {
+    pq->pool = (Entry *) calloc(capacity, sizeof(Entry));
+    if (pq->entries == NULL || pq->pool == NULL) {
+        free(pq->entries);
+        free(pq->pool);
         free(pq);
         return NULL;
     }
+    for (uint32_t i = 0; i < capacity; i++) {
+        pq->entries[i] = &pq->pool[i];
+    }
     return pq;
 }
 
@@ -39,9 +46,9 @@ PriorityQueue *pq_create(uint32_t capacity) {
 void pq_delete(PriorityQueue **q) {
     for (uint32_t i = 0; i < (*q)->size; i++) {
         free((*q)->entries[i]->name);
-        free((*q)->entries[i]);
     }
     free((*q)->entries);
+    free((*q)->pool);
     free(*q);
     *q = NULL;
     return;
@@ -132,10 +139,9 @@ bool enqueue(PriorityQueue *q, char *author, double dist) {
     if (pq_full(q)) {
         return false;
     }
-    Entry *a = (Entry *) malloc(sizeof(Entry));
+    Entry *a = q->entries[q->size++];
     a->name = author;
     a->dist = dist;
-    q->entries[q->size++] = a;
     build_heap(q->entries, 1, q->size);
     return true;
 }
@@ -153,8 +159,8 @@ bool dequeue(PriorityQueue *q, char **author, double *dist) {
     Entry *a = q->entries[0];
     *author = a->name;
     *dist = a->dist;
-    free(a);
     q->entries[0] = q->entries[--q->size];
+    q->entries[q->size] = a; // unused again
     build_heap(q->entries, 1, q->size);
     return true;
 }
@@ -0,0 +1,195 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "prefetch.h"
+
+// A file that has been read ahead, in memory that is kept for the next file.
+typedef struct {
+    char *data; // only ever grows, freed with the prefetcher
+    size_t capacity;
+    size_t length;
+    bool ok; // whether the file could be read
+} Buffer;
+
+// Reads a list of files on a background thread, staying up to depth files
+// ahead of the reader, so that the disk is busy while the texts are counted.
+// Every slot of the ring keeps its buffer, so once each has grown to the largest
+// file it is given, reading the rest of the files allocates nothing.
+struct Prefetcher {
+    char **paths;
+    uint32_t count;
+    uint32_t depth;
+    Buffer *ring; // depth + 1 slots, file i goes in slot i % (depth + 1), one lent to the reader
+    uint32_t head; // next file the reader will take
+    uint32_t tail; // next file the background thread will read
+    bool stop;
+    bool threaded; // whether there is a background thread, or files are read when taken
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t filled; // signalled when tail moves
+    pthread_cond_t emptied; // signalled when head moves or on stop
+};
+
+// Reads a whole file into a buffer, growing it if the file does not fit.
+// Returns: whether the file could be read.
+//
+// path: the path of the file
+// b: the buffer to read into
+static bool read_into(char *path, Buffer *b) {
+    b->length = 0;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return false;
+    }
+    posix_fadvise(fd, 0, st.st_size, POSIX_FADV_SEQUENTIAL);
+    if ((size_t) st.st_size + 1 > b->capacity) {
+        char *data = (char *) realloc(b->data, st.st_size + 1);
+        if (data == NULL) {
+            close(fd);
+            return false;
+        }
+        b->data = data;
+        b->capacity = st.st_size + 1;
+    }
+    while (b->length < (size_t) st.st_size) {
+        ssize_t n = read(fd, b->data + b->length, st.st_size - b->length);
+        if (n <= 0) {
+            break; // the file shrank, keep what there is
+        }
+        b->length += n;
+    }
+    close(fd);
+    return true;
+}
+
+// Background thread: reads the files in order into the ring.
+//
+// arg: the prefetcher
+static void *prefetch(void *arg) {
+    Prefetcher *pf = (Prefetcher *) arg;
+    pthread_mutex_lock(&pf->lock);
+    while (pf->tail < pf->count) {
+        while (!pf->stop && pf->tail - pf->head >= pf->depth) {
+            pthread_cond_wait(&pf->emptied, &pf->lock);
+        }
+        if (pf->stop) {
+            break;
+        }
+        uint32_t i = pf->tail;
+        pthread_mutex_unlock(&pf->lock);
+        // neither the reader nor the slots being waited on use this one
+        Buffer *b = &pf->ring[i % (pf->depth + 1)];
+        b->ok = read_into(pf->paths[i], b);
+        pthread_mutex_lock(&pf->lock);
+        pf->tail++;
+        pthread_cond_signal(&pf->filled);
+    }
+    pthread_mutex_unlock(&pf->lock);
+    return NULL;
+}
+
+// Creates a prefetcher and starts reading ahead.
+// Returns: a pointer to the prefetcher, or NULL on failure.
+//
+// paths: the files to read, in the order they will be taken
+// count: the number of files
+// depth: how many files may be read ahead, 0 to read each file when it is taken
+Prefetcher *pf_create(char **paths, uint32_t count, uint32_t depth) {
+    Prefetcher *pf = (Prefetcher *) malloc(sizeof(Prefetcher));
+    if (pf == NULL) {
+        return NULL;
+    }
+    pf->paths = paths;
+    pf->count = count;
+    pf->depth = depth;
+    pf->head = pf->tail = 0;
+    pf->stop = false;
+    pf->threaded = depth > 0;
+    pf->ring = (Buffer *) calloc(pf->depth + 1, sizeof(Buffer));
+    if (pf->ring == NULL) {
+        free(pf);
+        return NULL;
+    }
+    if (!pf->threaded) {
+        return pf;
+    }
+    pthread_mutex_init(&pf->lock, NULL);
+    pthread_cond_init(&pf->filled, NULL);
+    pthread_cond_init(&pf->emptied, NULL);
+    if (pthread_create(&pf->thread, NULL, prefetch, pf)) {
+        pthread_mutex_destroy(&pf->lock);
+        pthread_cond_destroy(&pf->filled);
+        pthread_cond_destroy(&pf->emptied);
+        free(pf->ring);
+        free(pf);
+        return NULL;
+    }
+    return pf;
+}
+
+// Stops the background thread and deletes the prefetcher with all of its buffers.
+//
+// pf: a pointer to the address of the prefetcher
+void pf_delete(Prefetcher **pf) {
+    Prefetcher *p = *pf;
+    if (p->threaded) {
+        pthread_mutex_lock(&p->lock);
+        p->stop = true;
+        pthread_cond_signal(&p->emptied);
+        pthread_mutex_unlock(&p->lock);
+        pthread_join(p->thread, NULL);
+        pthread_mutex_destroy(&p->lock);
+        pthread_cond_destroy(&p->filled);
+        pthread_cond_destroy(&p->emptied);
+    }
+    for (uint32_t i = 0; i <= p->depth; i++) {
+        free(p->ring[i].data);
+    }
+    free(p->ring);
+    free(p);
+    *pf = NULL;
+    return;
+}
+
+// Takes the contents of the next file, waiting for it to be read if it is not ready yet.
+// The contents stay the prefetcher's, and are only valid until the next call or pf_delete.
+// Returns: the contents, or NULL if the file could not be read or every file was taken.
+//
+// pf: the prefetcher
+// path: the path of the file, which must be the prefetcher's next file
+// length: where to store the length of the contents
+char *pf_take(Prefetcher *pf, char *path, size_t *length) {
+    if (!pf->threaded) {
+        if (pf->head >= pf->count) {
+            return NULL;
+        }
+        pf->head++;
+        pf->ring[0].ok = read_into(path, &pf->ring[0]);
+        *length = pf->ring[0].length;
+        return pf->ring[0].ok ? pf->ring[0].data : NULL;
+    }
+    pthread_mutex_lock(&pf->lock);
+    if (pf->head >= pf->count) {
+        pthread_mutex_unlock(&pf->lock);
+        return NULL;
+    }
+    while (pf->head >= pf->tail) {
+        pthread_cond_wait(&pf->filled, &pf->lock);
+    }
+    // taking this file gives back the one taken before, so the thread may refill its slot
+    Buffer *b = &pf->ring[pf->head % (pf->depth + 1)];
+    pf->head++;
+    pthread_cond_signal(&pf->emptied);
+    pthread_mutex_unlock(&pf->lock);
+    *length = b->length;
+    return b->ok ? b->data : NULL;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct Prefetcher Prefetcher;
+
+Prefetcher *pf_create(char **paths, uint32_t count, uint32_t depth);
+
+void pf_delete(Prefetcher **pf);
+
+char *pf_take(Prefetcher *pf, char *path, size_t *length);
@@ -0,0 +1,352 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "profile.h"
+#include "stats.h"
+
+// Creates a profile with room for the given number of terms.
+// Returns: a pointer to the profile, or NULL on failure.
+//
+// size: the number of terms
+Profile *profile_create(uint32_t size) {
+    Profile *p = (Profile *) malloc(sizeof(Profile));
+    if (p == NULL) {
+        return NULL;
+    }
+    p->size = size;
+    p->terms = (Term *) malloc((size > 0 ? size : 1) * sizeof(Term));
+    if (p->terms == NULL) {
+        free(p);
+        return NULL;
+    }
+    return p;
+}
+
+// Deletes the profile.
+//
+// p: a pointer to the address of the profile
+void profile_delete(Profile **p) {
+    free((*p)->terms);
+    free(*p);
+    *p = NULL;
+    return;
+}
+
+static int compare_terms(const void *a, const void *b) {
+    uint32_t x = ((const Term *) a)->id, y = ((const Term *) b)->id;
+    return (x > y) - (x < y);
+}
+
+// Sorts the profile's terms by id, which profile_dist relies on.
+//
+// p: the profile to sort
+void profile_sort(Profile *p) {
+    qsort(p->terms, p->size, sizeof(Term), compare_terms);
+    return;
+}
+
+// Adds two sorted profiles term by term.
+// Returns: the sum, or NULL on failure.
+//
+// a: the first profile
+// b: the second profile
+static Profile *profile_add(Profile *a, Profile *b) {
+    Profile *sum = profile_create(a->size + b->size);
+    if (sum == NULL) {
+        return NULL;
+    }
+    uint32_t i = 0, j = 0, k = 0;
+    while (i < a->size || j < b->size) {
+        if (j == b->size || (i < a->size && a->terms[i].id < b->terms[j].id)) {
+            sum->terms[k++] = a->terms[i++];
+        } else if (i == a->size || b->terms[j].id < a->terms[i].id) {
+            sum->terms[k++] = b->terms[j++];
+        } else {
+            sum->terms[k++] = (Term) { a->terms[i].id, a->terms[i++].freq + b->terms[j++].freq };
+        }
+    }
+    sum->size = k;
+    return sum;
+}
+
+// Averages sorted profiles into one, so that an author with several texts
+// is compared as a single profile.
+// Returns: the centroid, sorted, or NULL on failure.
+//
+// profiles: the profiles to average
+// n: the number of profiles, at least 1
+Profile *profile_centroid(Profile **profiles, uint32_t n) {
+    Profile *centroid = profile_create(0);
+    for (uint32_t i = 0; centroid != NULL && i < n; i++) {
+        Profile *sum = profile_add(centroid, profiles[i]);
+        profile_delete(&centroid);
+        centroid = sum;
+    }
+    if (centroid == NULL) {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < centroid->size; i++) {
+        centroid->terms[i].freq /= n;
+    }
+    return centroid;
+}
+
+// Sums the distances of every word of two profiles, before the metric's final step.
+// Returns: the sum.
+//
+// p1: the first profile
+// p2: the second profile
+// metric: the algorithm to use for the calculations
+static double profile_sum(Profile *p1, Profile *p2, Metric metric) {
+    double total = 0;
+    uint32_t i = 0, j = 0;
+    // merge the sorted terms, words in only one profile have frequency 0 in the other
+    while (i < p1->size && j < p2->size) {
+        uint32_t a = p1->terms[i].id, b = p2->terms[j].id;
+        if (a == b) {
+            total += freq_dist(p1->terms[i++].freq, p2->terms[j++].freq, metric);
+        } else if (a < b) {
+            total += freq_dist(p1->terms[i++].freq, 0, metric);
+        } else {
+            total += freq_dist(0, p2->terms[j++].freq, metric);
+        }
+    }
+    for (; i < p1->size; i++) {
+        total += freq_dist(p1->terms[i].freq, 0, metric);
+    }
+    for (; j < p2->size; j++) {
+        total += freq_dist(0, p2->terms[j].freq, metric);
+    }
+    return total;
+}
+
+// Applies the metric's final step to a sum of word distances.
+// Returns: the distance.
+//
+// total: the sum
+// metric: the algorithm to use for the calculations
+static double finish(double total, Metric metric) {
+    switch (metric) {
+    case MANHATTAN: return total;
+    case EUCLIDEAN: return sqrt(total);
+    case COSINE: return 1 - total;
+    default: fprintf(stderr, "Unknown Metric used.\n"); return -1;
+    }
+}
+
+// Returns the distance between two profiles, the same as text_dist
+// between the texts they were made from.
+//
+// p1: the first profile
+// p2: the second profile
+// metric: the algorithm to use for the calculations
+double profile_dist(Profile *p1, Profile *p2, Metric metric) {
+    return finish(profile_sum(p1, p2, metric), metric);
+}
+
+// Counts the terms of a profile whose ids are below a bound. Since the terms
+// are sorted, they are the first ones, and the rest are a tail of words that
+// were given ids later, such as those no library text has.
+// Returns: the number of terms.
+//
+// p: the profile
+// known: the bound
+uint32_t profile_known(Profile *p, uint32_t known) {
+    uint32_t lo = 0, hi = p->size;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (p->terms[mid].id < known) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Sums the distances of the terms of a profile from an index on, as if no
+// other profile has them. The sum is the same against every such profile.
+// Returns: the sum, before the metric's final step.
+//
+// p: the profile
+// from: the index of the first term
+// metric: the algorithm to use for the calculations
+double profile_tail(Profile *p, uint32_t from, Metric metric) {
+    double total = 0;
+    for (uint32_t i = from; i < p->size; i++) {
+        total += freq_dist(0, p->terms[i].freq, metric);
+    }
+    return total;
+}
+
+// Returns the sum of the squared frequencies of a profile.
+//
+// p: the profile
+double profile_norm(Profile *p) {
+    double norm = 0;
+    for (uint32_t i = 0; i < p->size; i++) {
+        norm += p->terms[i].freq * p->terms[i].freq;
+    }
+    return norm;
+}
+
+// Finds the frequency of a word in a profile.
+// Returns: the frequency, 0 if the profile does not have the word.
+//
+// p: the profile
+// id: the id of the word
+static double find_freq(Profile *p, uint32_t id) {
+    uint32_t i = profile_known(p, id);
+    return i < p->size && p->terms[i].id == id ? p->terms[i].freq : 0;
+}
+
+// Estimates the distance between two profiles from a few terms of the second,
+// usually its most frequent ones. Each metric is rewritten so that the words
+// left out could only make the distance smaller, so the estimate is an upper
+// bound, and it is exact once top holds every term. Both profiles' frequencies
+// are taken to add up to 1.
+// Returns: the estimate.
+//
+// p1: the first profile
+// norm1: the profile_norm of p1
+// top: some terms of the second profile, sorted by id
+// norm2: the profile_norm of the whole second profile
+// metric: the algorithm to use for the calculations
+double profile_estimate(Profile *p1, double norm1, Profile *top, double norm2, Metric metric) {
+    double shared = 0;
+    for (uint32_t i = 0; i < top->size; i++) {
+        double f1 = find_freq(p1, top->terms[i].id), f2 = top->terms[i].freq;
+        shared += metric == MANHATTAN ? (f1 < f2 ? f1 : f2) : f1 * f2;
+    }
+    switch (metric) {
+    case MANHATTAN: return 2 - 2 * shared; // |a - b| = a + b - 2 min(a, b)
+    case EUCLIDEAN: {
+        double total = norm1 + norm2 - 2 * shared; // (a - b)^2 = a^2 + b^2 - 2ab
+        return sqrt(total > 0 ? total : 0);
+    }
+    case COSINE: return 1 - shared;
+    default: fprintf(stderr, "Unknown Metric used.\n"); return -1;
+    }
+}
+
+// Returns the distance between two profiles, where the terms p2 has that p1
+// cannot have were cut off and summed up front by profile_tail.
+//
+// p1: the first profile
+// p2: the second profile, without its tail
+// tail: the profile_tail of the terms cut from p2
+// metric: the algorithm to use for the calculations
+double profile_dist_tail(Profile *p1, Profile *p2, double tail, Metric metric) {
+    return finish(profile_sum(p1, p2, metric) + tail, metric);
+}
+
+// The largest quantized frequency.
+#define QUANT_MAX UINT16_MAX
+
+// Packs a sorted profile. Frequencies are rounded to the nearest multiple of the
+// largest one over QUANT_MAX, so each is off by at most half of that step.
+// Returns: the packed profile, or NULL on failure.
+//
+// p: the profile to pack, unchanged
+PackedProfile *profile_pack(Profile *p) {
+    double max = 0;
+    for (uint32_t i = 0; i < p->size; i++) {
+        max = p->terms[i].freq > max ? p->terms[i].freq : max;
+    }
+    // at most 5 bytes of varint and 2 of frequency per term
+    PackedProfile *pp = (PackedProfile *) malloc(sizeof(PackedProfile) + p->size * 7);
+    if (pp == NULL) {
+        return NULL;
+    }
+    pp->size = p->size;
+    pp->scale = max > 0 ? max / QUANT_MAX : 1;
+    uint8_t *out = pp->data;
+    uint32_t last = 0;
+    for (uint32_t i = 0; i < p->size; i++) {
+        uint32_t gap = p->terms[i].id - last;
+        last = p->terms[i].id;
+        for (; gap >= 0x80; gap >>= 7) {
+            *out++ = (uint8_t) (gap | 0x80);
+        }
+        *out++ = (uint8_t) gap;
+        uint16_t q = (uint16_t) lround(p->terms[i].freq / pp->scale);
+        memcpy(out, &q, sizeof(q));
+        out += sizeof(q);
+    }
+    pp->bytes = out - pp->data;
+    stats_count(PACKED_BYTES, sizeof(PackedProfile) + pp->bytes);
+    stats_count(UNPACKED_BYTES, sizeof(Profile) + p->size * sizeof(Term));
+    PackedProfile *shrunk = (PackedProfile *) realloc(pp, sizeof(PackedProfile) + pp->bytes);
+    return shrunk != NULL ? shrunk : pp;
+}
+
+// Deletes the packed profile.
+//
+// pp: a pointer to the address of the packed profile
+void packed_delete(PackedProfile **pp) {
+    free(*pp);
+    *pp = NULL;
+    return;
+}
+
+// Bounds how far packed_dist_tail may be from profile_dist_tail on the profile
+// before it was packed. Every frequency is off by at most h, half a quantization
+// step, and only the packed profile's terms are off: Manhattan distances move by
+// at most h per term, Euclidean ones by at most h times the square root of the
+// number of terms, and cosine ones by h times the other profile's frequencies,
+// which add up to at most 1.
+// Returns: the bound.
+//
+// pp: the packed profile
+// metric: the metric of the distance
+double packed_error(PackedProfile *pp, Metric metric) {
+    double h = pp->scale / 2;
+    switch (metric) {
+    case MANHATTAN: return pp->size * h;
+    case EUCLIDEAN: return sqrt(pp->size) * h;
+    case COSINE: return h;
+    default: fprintf(stderr, "Unknown Metric used.\n"); return 0;
+    }
+}
+
+// Returns the distance between a packed profile and a profile, decoding the
+// packed terms as they are merged, like profile_dist_tail.
+//
+// p1: the packed profile
+// p2: the second profile, without its tail
+// tail: the profile_tail of the terms cut from p2
+// metric: the algorithm to use for the calculations
+double packed_dist_tail(PackedProfile *p1, Profile *p2, double tail, Metric metric) {
+    double total = 0;
+    const uint8_t *in = p1->data;
+    uint32_t id = 0, j = 0;
+    for (uint32_t i = 0; i < p1->size; i++) {
+        uint32_t gap = 0;
+        for (uint32_t shift = 0;; shift += 7) {
+            uint8_t byte = *in++;
+            gap |= (uint32_t) (byte & 0x7f) << shift;
+            if (byte < 0x80) {
+                break;
+            }
+        }
+        id += gap;
+        uint16_t q;
+        memcpy(&q, in, sizeof(q));
+        in += sizeof(q);
+        double f1 = q * p1->scale;
+        for (; j < p2->size && p2->terms[j].id < id; j++) {
+            total += freq_dist(0, p2->terms[j].freq, metric);
+        }
+        if (j < p2->size && p2->terms[j].id == id) {
+            total += freq_dist(f1, p2->terms[j++].freq, metric);
+        } else {
+            total += freq_dist(f1, 0, metric);
+        }
+    }
+    for (; j < p2->size; j++) {
+        total += freq_dist(0, p2->terms[j].freq, metric);
+    }
+    return finish(total + tail, metric);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "metric.h"
+
+#include <stdint.h>
+
+// One word of a profile: its vocabulary id and normalized frequency.
+typedef struct {
+    uint32_t id;
+    double freq;
+} Term;
+
+// A frozen text: just its word frequencies, sorted by vocabulary id,
+// so that two profiles can be compared in one merged pass.
+typedef struct {
+    uint32_t size;
+    Term *terms;
+} Profile;
+
+// A profile packed to a few bytes per term, to keep a large library resident.
+// Each term is the gap from the previous term's id as a varint, followed by its
+// frequency quantized to 16 bits, so the terms are decoded in order as they are merged.
+typedef struct {
+    uint32_t size; // number of terms
+    uint32_t bytes; // length of data
+    double scale; // a quantized frequency q stands for q * scale
+    uint8_t data[];
+} PackedProfile;
+
+Profile *profile_create(uint32_t size);
+
+void profile_delete(Profile **p);
+
+void profile_sort(Profile *p);
+
+Profile *profile_centroid(Profile **profiles, uint32_t n);
+
+double profile_dist(Profile *p1, Profile *p2, Metric metric);
+
+uint32_t profile_known(Profile *p, uint32_t known);
+
+double profile_tail(Profile *p, uint32_t from, Metric metric);
+
+double profile_dist_tail(Profile *p1, Profile *p2, double tail, Metric metric);
+
+double profile_norm(Profile *p);
+
+double profile_estimate(Profile *p1, double norm1, Profile *top, double norm2, Metric metric);
+
+PackedProfile *profile_pack(Profile *p);
+
+void packed_delete(PackedProfile **pp);
+
+double packed_error(PackedProfile *pp, Metric metric);
+
+double packed_dist_tail(PackedProfile *p1, Profile *p2, double tail, Metric metric);
@@ -0,0 +1,322 @@
+#include <inttypes.h>
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "salts.h"
+#include "sketch.h"
+#include "speck.h"
+
+#define EMPTY UINT32_MAX
+
+// Graham Cormode and S. Muthukrishnan, "An improved data stream summary:
+// the count-min sketch and its applications," Journal of Algorithms 55(1), 2005.
+//
+// Ahmed Metwally, Divyakant Agrawal and Amr El Abbadi, "Efficient computation
+// of frequent and top-k elements in data streams," ICDT 2005.
+
+// A word tracked by the Space-Saving algorithm.
+typedef struct {
+    char *word;
+    uint64_t count; // never less than the true count
+    uint64_t error; // how much of count may belong to evicted words
+    uint32_t heap; // position in the heap
+} Heavy;
+
+// Approximate word counts in fixed memory: a Count-Min sketch gives an
+// estimate for any word, and a Space-Saving summary keeps the most frequent
+// words themselves, since the sketch cannot list what it has seen.
+struct Sketch {
+    uint64_t primary[2];
+    uint64_t secondary[2];
+    uint32_t width; // power of 2
+    uint32_t depth;
+    uint32_t *table; // depth rows of width counters
+    uint64_t total;
+    uint32_t capacity; // number of heavy hitters kept
+    uint32_t used;
+    Heavy *heavy;
+    uint32_t *heap; // indices into heavy, smallest count first
+    uint32_t mask; // number of slots - 1
+    uint32_t *slots; // index into heavy of the word hashed there, or EMPTY
+};
+
+// Creates a sketch.
+// Returns: a pointer to the sketch, or NULL on failure.
+//
+// width: the number of counters per row, rounded up to a power of 2
+// depth: the number of rows
+// heavy: the number of most frequent words to keep
+Sketch *sketch_create(uint32_t width, uint32_t depth, uint32_t heavy) {
+    Sketch *sk = (Sketch *) calloc(1, sizeof(Sketch));
+    if (sk == NULL) {
+        return NULL;
+    }
+    sk->primary[0] = SALT_PRIMARY_LO;
+    sk->primary[1] = SALT_PRIMARY_HI;
+    sk->secondary[0] = SALT_SECONDARY_LO;
+    sk->secondary[1] = SALT_SECONDARY_HI;
+    sk->width = 1;
+    while (sk->width < width && sk->width < (1u << 31)) {
+        sk->width <<= 1;
+    }
+    sk->depth = depth > 0 ? depth : 1;
+    sk->capacity = heavy > 0 ? heavy : 1;
+    uint32_t slots = 2;
+    while (slots < 2 * (uint64_t) sk->capacity) {
+        slots <<= 1;
+    }
+    sk->mask = slots - 1;
+    sk->table = (uint32_t *) calloc((size_t) sk->width * sk->depth, sizeof(uint32_t));
+    sk->heavy = (Heavy *) calloc(sk->capacity, sizeof(Heavy));
+    sk->heap = (uint32_t *) calloc(sk->capacity, sizeof(uint32_t));
+    sk->slots = (uint32_t *) malloc(slots * sizeof(uint32_t));
+    if (sk->table == NULL || sk->heavy == NULL || sk->heap == NULL || sk->slots == NULL) {
+        sketch_delete(&sk);
+        return NULL;
+    }
+    memset(sk->slots, 0xff, slots * sizeof(uint32_t));
+    return sk;
+}
+
+// Deletes the sketch.
+//
+// sk: a pointer to the address of the sketch
+void sketch_delete(Sketch **sk) {
+    for (uint32_t i = 0; i < (*sk)->used; i++) {
+        free((*sk)->heavy[i].word);
+    }
+    free((*sk)->table);
+    free((*sk)->heavy);
+    free((*sk)->heap);
+    free((*sk)->slots);
+    free(*sk);
+    *sk = NULL;
+    return;
+}
+
+// Finds the slot for a word, either the one holding it or the first empty one.
+// Returns: the index of the slot.
+//
+// sk: the sketch
+// word: the word to look for
+// h: the primary hash of the word
+static uint32_t find_slot(Sketch *sk, char *word, uint32_t h) {
+    uint32_t i = h & sk->mask;
+    while (sk->slots[i] != EMPTY && strcmp(sk->heavy[sk->slots[i]].word, word) != 0) {
+        i = (i + 1) & sk->mask;
+    }
+    return i;
+}
+
+// Removes a slot, shifting later slots of the same cluster back
+// so that lookups never stop early at the hole.
+//
+// sk: the sketch
+// i: the slot to empty
+static void remove_slot(Sketch *sk, uint32_t i) {
+    uint32_t j = i;
+    while (true) {
+        j = (j + 1) & sk->mask;
+        if (sk->slots[j] == EMPTY) {
+            break;
+        }
+        uint32_t home = hash(sk->primary, sk->heavy[sk->slots[j]].word) & sk->mask;
+        // move j into the hole unless its home lies cyclically in (i, j]
+        if (((j - home) & sk->mask) >= ((j - i) & sk->mask)) {
+            sk->slots[i] = sk->slots[j];
+            i = j;
+        }
+    }
+    sk->slots[i] = EMPTY;
+    return;
+}
+
+// Swaps two heap entries, keeping their positions up to date.
+static inline void heap_swap(Sketch *sk, uint32_t a, uint32_t b) {
+    uint32_t t = sk->heap[a];
+    sk->heap[a] = sk->heap[b];
+    sk->heap[b] = t;
+    sk->heavy[sk->heap[a]].heap = a;
+    sk->heavy[sk->heap[b]].heap = b;
+}
+
+// Moves a heap entry down after its count grew.
+//
+// sk: the sketch
+// i: the position of the entry
+static void sift_down(Sketch *sk, uint32_t i) {
+    while (true) {
+        uint32_t smallest = i, l = 2 * i + 1, r = l + 1;
+        if (l < sk->used && sk->heavy[sk->heap[l]].count < sk->heavy[sk->heap[smallest]].count) {
+            smallest = l;
+        }
+        if (r < sk->used && sk->heavy[sk->heap[r]].count < sk->heavy[sk->heap[smallest]].count) {
+            smallest = r;
+        }
+        if (smallest == i) {
+            return;
+        }
+        heap_swap(sk, i, smallest);
+        i = smallest;
+    }
+}
+
+// Moves a heap entry up after it was added.
+//
+// sk: the sketch
+// i: the position of the entry
+static void sift_up(Sketch *sk, uint32_t i) {
+    while (i > 0 && sk->heavy[sk->heap[(i - 1) / 2]].count > sk->heavy[sk->heap[i]].count) {
+        heap_swap(sk, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+// Returns the number of bytes the sketch takes, with the words it keeps.
+//
+// sk: the sketch
+uint64_t sketch_bytes(Sketch *sk) {
+    uint64_t bytes = sizeof(Sketch) + (uint64_t) sk->width * sk->depth * sizeof(uint32_t)
+                     + (uint64_t) sk->capacity * (sizeof(Heavy) + sizeof(uint32_t))
+                     + ((uint64_t) sk->mask + 1) * sizeof(uint32_t);
+    for (uint32_t i = 0; i < sk->used; i++) {
+        bytes += strlen(sk->heavy[i].word) + 1;
+    }
+    return bytes;
+}
+
+// Counts one occurrence of a word.
+//
+// sk: the sketch
+// word: the word to count
+void sketch_insert(Sketch *sk, char *word) {
+    uint32_t h1 = hash(sk->primary, word), h2 = hash(sk->secondary, word) | 1;
+    // Kirsch and Mitzenmacher: rows hashed as h1 + i * h2 are as good as independent hashes
+    for (uint32_t i = 0; i < sk->depth; i++) {
+        uint32_t *c = &sk->table[(size_t) i * sk->width + ((h1 + i * h2) & (sk->width - 1))];
+        *c += *c < UINT32_MAX;
+    }
+    sk->total++;
+
+    uint32_t slot = find_slot(sk, word, h1);
+    uint32_t index = sk->slots[slot];
+    if (index != EMPTY) {
+        sk->heavy[index].count++;
+        sift_down(sk, sk->heavy[index].heap);
+        return;
+    }
+    char *copy = strdup(word);
+    if (copy == NULL) {
+        return;
+    }
+    if (sk->used < sk->capacity) {
+        index = sk->used++;
+        sk->heavy[index] = (Heavy) { .word = copy, .count = 1, .error = 0, .heap = index };
+        sk->heap[index] = index;
+        sk->slots[slot] = index;
+        sift_up(sk, index);
+        return;
+    }
+    // full: the least counted word makes way, and the new word inherits its count
+    index = sk->heap[0];
+    Heavy *victim = &sk->heavy[index];
+    remove_slot(sk, find_slot(sk, victim->word, hash(sk->primary, victim->word)));
+    free(victim->word);
+    victim->word = copy;
+    victim->error = victim->count;
+    victim->count++;
+    sk->slots[find_slot(sk, word, h1)] = index;
+    sift_down(sk, 0);
+    return;
+}
+
+// Estimates how many times the word was counted.
+// The estimate is never too low, and too high by at most epsilon * total
+// with probability at least 1 - delta.
+// Returns: the estimate.
+//
+// sk: the sketch
+// word: the word to look up
+uint64_t sketch_estimate(Sketch *sk, char *word) {
+    uint32_t h1 = hash(sk->primary, word), h2 = hash(sk->secondary, word) | 1;
+    uint32_t min = UINT32_MAX;
+    for (uint32_t i = 0; i < sk->depth; i++) {
+        uint32_t c = sk->table[(size_t) i * sk->width + ((h1 + i * h2) & (sk->width - 1))];
+        min = c < min ? c : min;
+    }
+    return min;
+}
+
+// Returns the number of words counted.
+//
+// sk: the sketch
+uint64_t sketch_total(Sketch *sk) {
+    return sk->total;
+}
+
+// Returns the number of heavy hitters kept.
+//
+// sk: the sketch
+uint32_t sketch_heavy_count(Sketch *sk) {
+    return sk->used;
+}
+
+// Returns a heavy hitter, in no particular order.
+//
+// sk: the sketch
+// i: the index of the heavy hitter, less than sketch_heavy_count
+char *sketch_heavy_word(Sketch *sk, uint32_t i) {
+    return sk->heavy[i].word;
+}
+
+// Returns whether the word is one of the heavy hitters.
+//
+// sk: the sketch
+// word: the word to look for
+bool sketch_heavy_contains(Sketch *sk, char *word) {
+    return sk->slots[find_slot(sk, word, hash(sk->primary, word))] != EMPTY;
+}
+
+// Returns the largest error of an estimate, as a fraction of the total.
+//
+// sk: the sketch
+double sketch_epsilon(Sketch *sk) {
+    return M_E / sk->width;
+}
+
+// Returns the probability that an estimate is off by more than epsilon.
+//
+// sk: the sketch
+double sketch_delta(Sketch *sk) {
+    return exp(-(double) sk->depth);
+}
+
+// Returns an upper bound on the fraction of the total that belongs to
+// words that are not heavy hitters.
+//
+// sk: the sketch
+double sketch_tail(Sketch *sk) {
+    if (sk->total == 0) {
+        return 0;
+    }
+    uint64_t kept = 0; // guaranteed occurrences of the heavy hitters
+    for (uint32_t i = 0; i < sk->used; i++) {
+        kept += sk->heavy[i].count - sk->heavy[i].error;
+    }
+    return 1 - kept / (double) sk->total;
+}
+
+// Debug function to print the sketch.
+//
+// sk: the sketch to print
+void sketch_print(Sketch *sk) {
+    printf("Width: %" PRIu32 " Depth: %" PRIu32 " Total: %" PRIu64 "\n", sk->width, sk->depth,
+        sk->total);
+    for (uint32_t i = 0; i < sk->used; i++) {
+        printf("%s: %" PRIu64 " (+%" PRIu64 ")\n", sk->heavy[i].word, sk->heavy[i].count,
+            sk->heavy[i].error);
+    }
+    return;
+}
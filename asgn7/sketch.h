@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct Sketch Sketch;
+
+Sketch *sketch_create(uint32_t width, uint32_t depth, uint32_t heavy);
+
+void sketch_delete(Sketch **sk);
+
+uint64_t sketch_bytes(Sketch *sk);
+
+void sketch_insert(Sketch *sk, char *word);
+
+uint64_t sketch_estimate(Sketch *sk, char *word);
+
+uint64_t sketch_total(Sketch *sk);
+
+uint32_t sketch_heavy_count(Sketch *sk);
+
+char *sketch_heavy_word(Sketch *sk, uint32_t i);
+
+bool sketch_heavy_contains(Sketch *sk, char *word);
+
+double sketch_epsilon(Sketch *sk);
+
+double sketch_delta(Sketch *sk);
+
+double sketch_tail(Sketch *sk);
+
+void sketch_print(Sketch *sk);
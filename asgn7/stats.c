@@ -0,0 +1,285 @@
+#include <inttypes.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#include "stats.h"
+
+bool stats_timing = false;
+
+_Thread_local Stats thread_stats;
+
+// Per-thread stats are merged in here by stats_flush.
+static Stats totals;
+static pthread_mutex_t totals_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *counter_names[] = { [HT_LOOKUPS] = "ht_lookups",
+    [LOOKUP_PROBES] = "lookup_probes",
+    [HT_INSERTIONS] = "ht_insertions",
+    [INSERTION_PROBES] = "insertion_probes",
+    [BF_LOOKUPS] = "bf_lookups",
+    [BF_FALSE_POSITIVES] = "bf_false_positives",
+    [BF_BYPASSES] = "bf_bypasses",
+    [TEXTS] = "texts",
+    [WORDS] = "words",
+    [CACHE_HITS] = "cache_hits",
+    [CACHE_DISK_HITS] = "cache_disk_hits",
+    [FP_COLLISIONS] = "fp_collisions",
+    [PACKED_BYTES] = "packed_bytes",
+    [UNPACKED_BYTES] = "unpacked_bytes" };
+
+static const char *structure_names[] = { [MEM_TEXT] = "text",
+    [MEM_HASH_TABLE] = "hash_table",
+    [MEM_BLOOM_FILTER] = "bloom_filter",
+    [MEM_SKETCH] = "sketch",
+    [MEM_FINGERPRINTS] = "fingerprint_table" };
+
+static const char *structure_titles[] = { [MEM_TEXT] = "Text",
+    [MEM_HASH_TABLE] = "Hash Table",
+    [MEM_BLOOM_FILTER] = "Bloom Filter",
+    [MEM_SKETCH] = "Sketch",
+    [MEM_FINGERPRINTS] = "Fingerprint Table" };
+
+static const char *stage_names[] = {
+    [TOKENIZE] = "tokenize", [NOISE] = "noise", [INSERT] = "insert", [DISTANCE] = "distance",
+    [RANK] = "rank"
+};
+
+// Returns: the monotonic clock in nanoseconds.
+uint64_t stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Records the load of a library text's hash table.
+//
+// load: the fraction of used slots
+void stats_load(double load) {
+    thread_stats.load_sum += load;
+    if (load > thread_stats.max_load) {
+        thread_stats.max_load = load;
+    }
+    return;
+}
+
+// Records the longest run of used slots in a library text's hash table.
+//
+// run: the length of the run
+void stats_run(uint64_t run) {
+    if (run > thread_stats.longest_run) {
+        thread_stats.longest_run = run;
+    }
+    return;
+}
+
+// Returns: the larger of a and b.
+static inline uint64_t max(uint64_t a, uint64_t b) {
+    return a > b ? a : b;
+}
+
+// Finds the probe length that the given fraction of operations did not exceed.
+// Returns: the probe length, or PROBE_BUCKETS if it falls in the overflow bucket.
+//
+// hist: the probe length histogram
+// p: the fraction, between 0 and 1
+uint64_t stats_percentile(uint64_t *hist, double p) {
+    uint64_t total = 0;
+    for (int i = 0; i < PROBE_BUCKETS; i++) {
+        total += hist[i];
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < PROBE_BUCKETS; i++) {
+        seen += hist[i];
+        if (seen > 0 && seen >= p * total) {
+            return i + 1;
+        }
+    }
+    return 0; // empty histogram
+}
+
+// Adds one set of stats to another.
+//
+// to: the stats to add to
+// from: the stats to add
+static void add(Stats *to, Stats *from) {
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        to->counters[i] += from->counters[i];
+    }
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        to->stage_ns[i] += from->stage_ns[i];
+    }
+    to->load_sum += from->load_sum;
+    if (from->max_load > to->max_load) {
+        to->max_load = from->max_load;
+    }
+    for (int i = 0; i < PROBE_BUCKETS; i++) {
+        to->insert_hist[i] += from->insert_hist[i];
+        to->lookup_hist[i] += from->lookup_hist[i];
+    }
+    to->max_insert_probes = max(to->max_insert_probes, from->max_insert_probes);
+    to->max_lookup_probes = max(to->max_lookup_probes, from->max_lookup_probes);
+    to->max_displacement = max(to->max_displacement, from->max_displacement);
+    to->longest_run = max(to->longest_run, from->longest_run);
+    for (int i = 0; i < STRUCTURE_COUNT; i++) {
+        to->max_bytes[i] = max(to->max_bytes[i], from->max_bytes[i]);
+    }
+    return;
+}
+
+// Merges the calling thread's stats into the totals and clears them.
+// Every thread must call this before it exits.
+void stats_flush(void) {
+    pthread_mutex_lock(&totals_lock);
+    add(&totals, &thread_stats);
+    pthread_mutex_unlock(&totals_lock);
+    memset(&thread_stats, 0, sizeof(Stats));
+    return;
+}
+
+// Merges stats collected elsewhere, such as by another process, into the totals.
+//
+// stats: the stats to merge
+void stats_merge(Stats *stats) {
+    pthread_mutex_lock(&totals_lock);
+    add(&totals, stats);
+    pthread_mutex_unlock(&totals_lock);
+    return;
+}
+
+// Clears the calling thread's stats and the totals, so a forked process
+// counts only what it does itself. Only for a process with one thread.
+void stats_reset(void) {
+    memset(&thread_stats, 0, sizeof(Stats));
+    memset(&totals, 0, sizeof(Stats));
+    return;
+}
+
+// Flushes the calling thread and copies the merged totals.
+//
+// out: where to store the totals
+void stats_collect(Stats *out) {
+    stats_flush();
+    pthread_mutex_lock(&totals_lock);
+    *out = totals;
+    pthread_mutex_unlock(&totals_lock);
+    return;
+}
+
+// Returns: a / b, or 0 if b is 0.
+static double ratio(double a, double b) {
+    return b == 0 ? 0 : a / b;
+}
+
+static const double percentiles[] = { 0.5, 0.9, 0.99, 0.999 };
+static const char *percentile_names[] = { "p50", "p90", "p99", "p999" };
+#define PERCENTILES (sizeof(percentiles) / sizeof(percentiles[0]))
+
+// Prints the tail percentiles of a probe histogram on one line.
+//
+// outfile: the file to print to
+// name: the operation the histogram is for
+// hist: the histogram
+// max_probes: the longest probe sequence seen
+static void print_tail(FILE *outfile, char *name, uint64_t *hist, uint64_t max_probes) {
+    fprintf(outfile, "%s Probes", name);
+    for (size_t i = 0; i < PERCENTILES; i++) {
+        uint64_t probes = stats_percentile(hist, percentiles[i]);
+        fprintf(outfile, " %s: %s%" PRIu64, percentile_names[i], probes == PROBE_BUCKETS ? ">=" : "",
+            probes);
+    }
+    fprintf(outfile, " max: %" PRIu64 "\n", max_probes);
+    return;
+}
+
+// Prints a probe histogram and its percentiles as a JSON object.
+//
+// outfile: the file to print to
+// hist: the histogram
+// max_probes: the longest probe sequence seen
+static void print_hist_json(FILE *outfile, uint64_t *hist, uint64_t max_probes) {
+    // trailing empty buckets are left out
+    int last = PROBE_BUCKETS;
+    while (last > 0 && hist[last - 1] == 0) {
+        last--;
+    }
+    fprintf(outfile, "{\"histogram\":[");
+    for (int i = 0; i < last; i++) {
+        fprintf(outfile, "%s%" PRIu64, i ? "," : "", hist[i]);
+    }
+    fprintf(outfile, "]");
+    for (size_t i = 0; i < PERCENTILES; i++) {
+        fprintf(outfile, ",\"%s\":%" PRIu64, percentile_names[i],
+            stats_percentile(hist, percentiles[i]));
+    }
+    fprintf(outfile, ",\"max\":%" PRIu64 "}", max_probes);
+    return;
+}
+
+// Prints the human-readable verbose statistics.
+//
+// outfile: the file to print to
+// stats: the merged stats to print
+void stats_print(FILE *outfile, Stats *stats) {
+    uint64_t *c = stats->counters;
+    if (stats_timing) {
+        for (int i = 0; i < STAGE_COUNT; i++) {
+            fprintf(outfile, "Time in %s: %.3f ms\n", stage_names[i], stats->stage_ns[i] / 1e6);
+        }
+    }
+    print_tail(outfile, "Insertion", stats->insert_hist, stats->max_insert_probes);
+    print_tail(outfile, "Lookup", stats->lookup_hist, stats->max_lookup_probes);
+    fprintf(outfile, "Max Displacement: %" PRIu64 "\n", stats->max_displacement);
+    fprintf(outfile, "Longest Occupied Run: %" PRIu64 "\n", stats->longest_run);
+    fprintf(outfile, "Average Probes per Insertion: %f\n",
+        ratio(c[INSERTION_PROBES], c[HT_INSERTIONS]));
+    fprintf(outfile, "Average Probes per Lookup: %f\n", ratio(c[LOOKUP_PROBES], c[HT_LOOKUPS]));
+    fprintf(outfile, "Average Hash Table Load: %f\n", ratio(stats->load_sum, c[TEXTS]));
+    fprintf(outfile, "Max Hash Table Load: %f\n", stats->max_load);
+    fprintf(outfile, "Bloom Filter False Positive Rate: %f\n",
+        ratio(c[BF_FALSE_POSITIVES], c[BF_LOOKUPS]));
+    fprintf(outfile, "Bloom Filter Bypass Rate: %f\n",
+        ratio(c[BF_BYPASSES], c[BF_BYPASSES] + c[BF_LOOKUPS]));
+    for (int i = 0; i < STRUCTURE_COUNT; i++) {
+        if (stats->max_bytes[i] > 0) {
+            fprintf(outfile, "Largest %s: %" PRIu64 " bytes\n", structure_titles[i],
+                stats->max_bytes[i]);
+        }
+    }
+    return;
+}
+
+// Prints the stats as a single JSON object.
+//
+// outfile: the file to print to
+// stats: the merged stats to print
+// wall_seconds: the elapsed real time of the run
+// cpu_seconds: the user CPU time of the run
+// peak_bytes: the most memory the run held at once
+void stats_print_json(
+    FILE *outfile, Stats *stats, double wall_seconds, double cpu_seconds, uint64_t peak_bytes) {
+    fprintf(outfile, "{\"counters\":{");
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        fprintf(outfile, "%s\"%s\":%" PRIu64, i ? "," : "", counter_names[i], stats->counters[i]);
+    }
+    fprintf(outfile, "},\"stage_ns\":{");
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        fprintf(outfile, "%s\"%s\":%" PRIu64, i ? "," : "", stage_names[i], stats->stage_ns[i]);
+    }
+    fprintf(outfile, "},\"hash_table\":{\"average_load\":%.9g,\"max_load\":%.9g},",
+        ratio(stats->load_sum, stats->counters[TEXTS]), stats->max_load);
+    fprintf(outfile, "\"probes\":{\"insert\":");
+    print_hist_json(outfile, stats->insert_hist, stats->max_insert_probes);
+    fprintf(outfile, ",\"lookup\":");
+    print_hist_json(outfile, stats->lookup_hist, stats->max_lookup_probes);
+    fprintf(outfile, ",\"max_displacement\":%" PRIu64 ",\"longest_run\":%" PRIu64 "},",
+        stats->max_displacement, stats->longest_run);
+    fprintf(outfile, "\"max_bytes\":{");
+    for (int i = 0; i < STRUCTURE_COUNT; i++) {
+        fprintf(
+            outfile, "%s\"%s\":%" PRIu64, i ? "," : "", structure_names[i], stats->max_bytes[i]);
+    }
+    fprintf(outfile, "},\"peak_bytes\":%" PRIu64 ",", peak_bytes);
+    fprintf(outfile, "\"wall_seconds\":%.6f,\"cpu_seconds\":%.6f}\n", wall_seconds, cpu_seconds);
+    return;
+}
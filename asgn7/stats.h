@@ -0,0 +1,151 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Event counters. Each thread counts into its own copy, see stats_flush.
+typedef enum {
+    HT_LOOKUPS,
+    LOOKUP_PROBES,
+    HT_INSERTIONS,
+    INSERTION_PROBES,
+    BF_LOOKUPS,
+    BF_FALSE_POSITIVES,
+    BF_BYPASSES,
+    TEXTS,
+    WORDS,
+    CACHE_HITS,
+    CACHE_DISK_HITS,
+    FP_COLLISIONS,
+    PACKED_BYTES,
+    UNPACKED_BYTES,
+    COUNTER_COUNT
+} Counter;
+
+// Probe lengths 1 to PROBE_BUCKETS - 1 are counted exactly, longer ones share the last bucket.
+#define PROBE_BUCKETS 64
+
+// Structures whose memory is accounted, see stats_memory.
+typedef enum {
+    MEM_TEXT,
+    MEM_HASH_TABLE,
+    MEM_BLOOM_FILTER,
+    MEM_SKETCH,
+    MEM_FINGERPRINTS,
+    STRUCTURE_COUNT
+} Structure;
+
+// Stages of a run that can be timed.
+typedef enum { TOKENIZE, NOISE, INSERT, DISTANCE, RANK, STAGE_COUNT } Stage;
+
+typedef struct {
+    uint64_t counters[COUNTER_COUNT];
+    uint64_t stage_ns[STAGE_COUNT];
+    double load_sum; // sum of hash table loads, one per library text
+    double max_load;
+    uint64_t insert_hist[PROBE_BUCKETS]; // probe length histograms
+    uint64_t lookup_hist[PROBE_BUCKETS];
+    uint64_t max_insert_probes;
+    uint64_t max_lookup_probes;
+    uint64_t max_displacement; // furthest any node was placed from its home slot
+    uint64_t longest_run; // longest run of consecutive used slots
+    uint64_t max_bytes[STRUCTURE_COUNT]; // largest of each structure, in bytes
+} Stats;
+
+extern bool stats_timing; // Whether the stage timers are running.
+
+extern _Thread_local Stats thread_stats;
+
+// Adds n to the calling thread's counter.
+//
+// c: the counter to add to
+// n: the amount to add
+static inline void stats_count(Counter c, uint64_t n) {
+    thread_stats.counters[c] += n;
+}
+
+// Returns: the histogram bucket for the probe length.
+//
+// probes: the number of slots looked at
+static inline uint64_t probe_bucket(uint64_t probes) {
+    return probes < PROBE_BUCKETS ? probes - 1 : PROBE_BUCKETS - 1;
+}
+
+// Records a hash table insertion.
+//
+// probes: the number of slots looked at
+// created: whether a new node was placed, making probes - 1 its displacement
+static inline void stats_insert(uint64_t probes, bool created) {
+    thread_stats.counters[HT_INSERTIONS]++;
+    thread_stats.counters[INSERTION_PROBES] += probes;
+    thread_stats.insert_hist[probe_bucket(probes)]++;
+    if (probes > thread_stats.max_insert_probes) {
+        thread_stats.max_insert_probes = probes;
+    }
+    if (created && probes - 1 > thread_stats.max_displacement) {
+        thread_stats.max_displacement = probes - 1;
+    }
+}
+
+// Records a hash table lookup.
+//
+// probes: the number of slots looked at
+static inline void stats_lookup(uint64_t probes) {
+    thread_stats.counters[HT_LOOKUPS]++;
+    thread_stats.counters[LOOKUP_PROBES] += probes;
+    thread_stats.lookup_hist[probe_bucket(probes)]++;
+    if (probes > thread_stats.max_lookup_probes) {
+        thread_stats.max_lookup_probes = probes;
+    }
+}
+
+// Records the size of a structure.
+//
+// s: the kind of structure
+// bytes: the number of bytes it takes
+static inline void stats_memory(Structure s, uint64_t bytes) {
+    if (bytes > thread_stats.max_bytes[s]) {
+        thread_stats.max_bytes[s] = bytes;
+    }
+}
+
+uint64_t stats_now(void);
+
+// Returns: the current time if stage timing is enabled, otherwise 0.
+static inline uint64_t stats_start(void) {
+    return stats_timing ? stats_now() : 0;
+}
+
+// Charges the time since start to the given stage.
+// Returns: the current time, so consecutive stages can share one clock read.
+//
+// s: the stage to charge
+// start: the value returned by stats_start or a previous stats_stop
+static inline uint64_t stats_stop(Stage s, uint64_t start) {
+    if (!stats_timing) {
+        return 0;
+    }
+    uint64_t now = stats_now();
+    thread_stats.stage_ns[s] += now - start;
+    return now;
+}
+
+void stats_load(double load);
+
+void stats_run(uint64_t run);
+
+uint64_t stats_percentile(uint64_t *hist, double p);
+
+void stats_flush(void);
+
+void stats_merge(Stats *stats);
+
+void stats_reset(void);
+
+void stats_collect(Stats *out);
+
+void stats_print(FILE *outfile, Stats *stats);
+
+void stats_print_json(
+    FILE *outfile, Stats *stats, double wall_seconds, double cpu_seconds, uint64_t peak_bytes);
@@ -1,73 +1,681 @@
 #include <inttypes.h>
-#include <regex.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <math.h>
-#include <ctype.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "metric.h"
 #include "ht.h"
 #include "bf.h"
+#include "digest.h"
+#include "ft.h"
 #include "parser.h"
+#include "sketch.h"
+#include "stats.h"
 #include "text.h"
 
-#define REGEX "[a-zA-Z]+([a-zA-Z'-][a-zA-Z]+)*"
+// Inputs are only split across threads if every thread gets at least this many bytes.
+#define PARALLEL_CHUNK (1 << 22)
 
-uint32_t noiselimit = 100, hash_table_size = (1 << 19), bloom_filter_size = (1 << 21);
+// The multiplier of the rolling hash over characters, odd so it is invertible mod 2^64.
+#define GRAM_BASE UINT64_C(0x100000001b3)
 
-uint64_t bf_false_positives = 0, bf_lookups = 0;
+// Lookups between decisions on whether a call site uses the Bloom filter.
+#define SITE_WINDOW 1024
+
+// One lookup in this many is timed, to keep the costs of a call site measured.
+#define SITE_SAMPLE 32
+
+// Marks files written by text_write, bump it when the format or tokenizing changes.
+#define TEXT_MAGIC 0x31545854 // "TXT1"
+
+uint32_t hash_table_size = (1 << 19), bloom_filter_size = (1 << 21);
+uint32_t text_threads = 1;
+uint32_t sketch_width = (1 << 16), sketch_depth = 5, sketch_heavy = 10000;
+bool text_fingerprints = false, text_verify = false;
+bool text_bigrams = false;
+uint32_t text_char_ngrams = 0;
 
 // adapted from assignment
 struct Text {
-    HashTable *ht;
+    HashTable *ht; // NULL if the text is sketched or keyed by fingerprints
     BloomFilter *bf;
-    uint32_t word_count;
+    Sketch *sketch; // approximate counts in place of ht and bf, or NULL
+    FingerprintTable *ft; // counts without the words in place of ht and bf, or NULL
+    uint64_t word_count;
+    uint64_t bigram_count; // features counted besides the words, only with fingerprints
+    uint64_t gram_count;
+    uint64_t last; // fingerprint of the last word counted, for the next bigram
 };
 
+// The places words of one text are looked up in another, each deciding on its own
+// whether the Bloom filter in front of the hash table pays off.
+typedef enum { SITE_FREQUENCY, SITE_CONTAINS, SITE_COUNT } Site;
+
+// What a call site has measured. The filter saves a hash table lookup for every
+// word it rejects, and costs a probe for every word, so it only pays off when
+// misses * lookup_ns > lookups * filter_ns. Misses are seen whether or not the
+// filter is used, as a rejection or as an unsuccessful lookup, and a sample of the
+// probes and lookups is timed either way, so the decision is remade every SITE_WINDOW
+// lookups. The filter is used until both costs have been measured.
+typedef struct {
+    uint32_t lookups; // in the current window
+    uint32_t misses;
+    double filter_ns; // moving averages of a filter probe and a hash table lookup
+    double lookup_ns;
+    bool bypass; // whether the filter is skipped
+} SiteStats;
+
+// Every thread measures on its own, like the stats.
+static _Thread_local SiteStats sites[SITE_COUNT];
+
+// Adds a timed sample to a moving average.
+//
+// average: the average, 0 before the first sample
+// ns: the sample
+static inline void sample(double *average, uint64_t ns) {
+    *average = *average == 0 ? ns : *average + (ns - *average) / 8;
+}
+
+// Returns whether the text counts n-gram features besides its words.
+//
+// text: the text
+static inline bool featured(Text *text) {
+    return text->ft != NULL && (text_bigrams || text_char_ngrams > 0);
+}
+
+// Counts the n-gram features of a word that was just counted: its bigram with the
+// word counted before it, and the character n-grams of the word with a space on
+// either side. Both are hashed as the tokens go by, so no string is ever built:
+// a bigram combines the two word fingerprints, and the character n-grams come from
+// a polynomial hash rolled over the word, which drops the oldest character and
+// takes the next one in for every n-gram.
+// Returns: whether there was room for all of them.
+//
+// text: the text to count in
+// word: the word
+// key: the fingerprint of the word
+static bool add_features(Text *text, char *word, uint64_t key) {
+    if (text_bigrams) {
+        if (text->last != 0) {
+            uint64_t bigram = ft_feature(fmix(text->last * GRAM_BASE + key), FT_BIGRAM);
+            if (!ft_add_key(text->ft, bigram, NULL, 1)) {
+                return false;
+            }
+            text->bigram_count++;
+        }
+        text->last = key;
+    }
+    uint32_t n = text_char_ngrams;
+    if (n == 0) {
+        return true;
+    }
+    uint64_t top = 1; // GRAM_BASE^(n - 1), the weight of the oldest character
+    for (uint32_t i = 1; i < n; i++) {
+        top *= GRAM_BASE;
+    }
+    size_t length = strlen(word) + 2;
+    uint64_t hash = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (i >= n) {
+            unsigned char out = i - n == 0 ? ' ' : word[i - n - 1];
+            hash -= out * top;
+        }
+        unsigned char in = i == 0 || i == length - 1 ? ' ' : word[i - 1];
+        hash = hash * GRAM_BASE + in;
+        if (i + 1 >= n) {
+            if (!ft_add_key(text->ft, ft_feature(fmix(hash), FT_CHAR_NGRAM), NULL, 1)) {
+                return false;
+            }
+            text->gram_count++;
+        }
+    }
+    return true;
+}
+
+// Returns how many features of the same kind as the key the text counted,
+// which its frequency is taken out of.
+//
+// text: the text
+// key: the key of the feature
+static inline uint64_t kind_count(Text *text, uint64_t key) {
+    switch (ft_kind(key)) {
+    case FT_BIGRAM: return text->bigram_count;
+    case FT_CHAR_NGRAM: return text->gram_count;
+    default: return text->word_count;
+    }
+}
+
+// Adds one word read from a text to its hash table or sketch, unless it is noise.
+// Returns: 1 if the word was counted, 0 if it was noise, or -1 if the table is full.
+//
+// text: the text to count the word in, its Bloom filter may be NULL
+// word: the lowercased word
+// noise: the noise words to ignore
+// mark: the stage timer, updated as the word goes through each stage
+static inline int add_word(Text *text, char *word, NoiseSet *noise, uint64_t *mark) {
+    *mark = stats_stop(TOKENIZE, *mark);
+    // checks for NULL too, don't need to check that noise == NULL
+    bool is_noise = ns_contains(noise, word);
+    *mark = stats_stop(NOISE, *mark);
+    if (is_noise) {
+        return 0;
+    }
+    if (text->sketch != NULL) {
+        sketch_insert(text->sketch, word);
+    } else if (text->ft != NULL) {
+        uint64_t key = ft_fingerprint(word);
+        if (!ft_add_key(text->ft, key, word, 1)
+            || (featured(text) && !add_features(text, word, key))) {
+            fprintf(stderr, "Could not allocate memory for the fingerprint table.\n");
+            return -1;
+        }
+    } else if (!ht_insert(text->ht, word)) {
+        fprintf(stderr, "Hash table is full\n");
+        return -1;
+    } else if (text->bf != NULL) {
+        bf_insert(text->bf, word);
+    }
+    *mark = stats_stop(INSERT, *mark);
+    return 1;
+}
+
+// Counts the words of a stream, read a large block at a time.
+// Returns: the number of words counted.
+//
+// text: the text to count in
+// infile: the file to read from
+// noise: the noise words to ignore
+static uint64_t ingest_stream(Text *text, FILE *infile, NoiseSet *noise) {
+    WordStream *ws = ws_create(infile);
+    if (ws == NULL) {
+        fprintf(stderr, "Could not allocate memory for the stream.\n");
+        return 0;
+    }
+    char word[MAX_WORD];
+    uint64_t count = 0;
+    uint64_t mark = stats_start();
+    while (ws_next(ws, word) > 0) {
+        int added = add_word(text, word, noise, &mark);
+        if (added < 0) {
+            break;
+        }
+        count += added;
+    }
+    stats_stop(TOKENIZE, mark); // the final failed read
+    ws_delete(&ws);
+    return count;
+}
+
+// Counts the words of an in-memory buffer.
+// Returns: the number of words counted.
+//
+// text: the text to count in
+// start: the start of the buffer
+// end: the end of the buffer
+// noise: the noise words to ignore
+static uint64_t ingest_buffer(Text *text, char *start, char *end, NoiseSet *noise) {
+    char word[MAX_WORD];
+    uint64_t count = 0;
+    uint64_t mark = stats_start();
+    while (scan_word(&start, end, word) > 0) {
+        int added = add_word(text, word, noise, &mark);
+        if (added < 0) {
+            break;
+        }
+        count += added;
+    }
+    stats_stop(TOKENIZE, mark);
+    return count;
+}
+
+// One thread's share of a large buffer.
+typedef struct {
+    char *start;
+    char *end;
+    NoiseSet *noise;
+    Text local; // the thread's own table, merged in afterwards
+    uint64_t count;
+} Chunk;
+
+// Creates a chunk's own table, of the same kind as the text's.
+// Returns: whether it could be created.
+//
+// local: the chunk's text
+// text: the text the chunk is merged into
+static bool local_create(Text *local, Text *text) {
+    if (text->ft != NULL) {
+        local->ft = ft_create(FT_MIN_SLOTS, text_verify);
+        return local->ft != NULL;
+    }
+    local->ht = ht_create(ht_size(text->ht));
+    return local->ht != NULL;
+}
+
+// Adds a chunk's counts to the text and deletes the chunk's table.
+//
+// text: the text to add to
+// local: the chunk's text
+static void local_merge(Text *text, Text *local) {
+    if (local->ft != NULL) {
+        if (!ft_merge(text->ft, local->ft)) {
+            fprintf(stderr, "Could not allocate memory for the fingerprint table.\n");
+        }
+        ft_delete(&local->ft);
+        return;
+    }
+    HashTableIterator *hti = hti_create(local->ht);
+    Node *node;
+    while ((node = ht_iter(hti)) != NULL) {
+        Node *merged = ht_insert(text->ht, node->word);
+        if (merged == NULL) {
+            fprintf(stderr, "Hash table is full\n");
+            break;
+        }
+        merged->count += node->count - 1; // ht_insert already counted it once
+        bf_insert(text->bf, node->word);
+    }
+    hti_delete(&hti);
+    ht_delete(&local->ht);
+    return;
+}
+
+// Thread entry point: counts a chunk into its own table.
+//
+// arg: the chunk to count
+static void *ingest_chunk(void *arg) {
+    Chunk *chunk = (Chunk *) arg;
+    chunk->count = ingest_buffer(&chunk->local, chunk->start, chunk->end, chunk->noise);
+    stats_flush();
+    return NULL;
+}
+
+// Counts the words of a large buffer with several threads.
+// The buffer is cut only where no word can span the cut, every thread counts
+// its range into a private table, and the tables are then summed into the text,
+// so the counts are exactly those of a single pass.
+// Returns: the number of words counted.
+//
+// text: the text to count into
+// start: the start of the buffer
+// end: the end of the buffer
+// noise: the noise words to ignore
+// n: the number of threads to use
+static uint64_t ingest_parallel(Text *text, char *start, char *end, NoiseSet *noise, uint32_t n) {
+    Chunk *chunks = (Chunk *) calloc(n, sizeof(Chunk));
+    pthread_t *workers = (pthread_t *) calloc(n, sizeof(pthread_t));
+    if (chunks == NULL || workers == NULL) {
+        free(chunks);
+        free(workers);
+        return ingest_buffer(text, start, end, noise);
+    }
+    size_t share = (end - start) / n;
+    char *cut = start;
+    for (uint32_t i = 0; i < n; i++) {
+        chunks[i].start = cut;
+        cut = i == n - 1 ? end : word_boundary(start + (i + 1) * share, end);
+        if (cut < chunks[i].start) { // the previous boundary ran past this share
+            cut = chunks[i].start;
+        }
+        chunks[i].end = cut;
+        chunks[i].noise = noise;
+    }
+    uint32_t started = 0;
+    for (; started < n; started++) {
+        if (!local_create(&chunks[started].local, text)
+            || pthread_create(&workers[started], NULL, ingest_chunk, &chunks[started])) {
+            break;
+        }
+    }
+    uint64_t count = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        if (i < started) {
+            pthread_join(workers[i], NULL);
+        } else { // could not start a thread, so count the chunk here
+            if (chunks[i].local.ht == NULL && chunks[i].local.ft == NULL
+                && !local_create(&chunks[i].local, text)) {
+                count += ingest_buffer(text, chunks[i].start, chunks[i].end, chunks[i].noise);
+                continue;
+            }
+            ingest_chunk(&chunks[i]);
+        }
+        count += chunks[i].count;
+        local_merge(text, &chunks[i].local);
+    }
+    free(chunks);
+    free(workers);
+    return count;
+}
+
+// Maps the rest of a regular file into memory.
+// Returns: the start of the mapping, or NULL if the file cannot be mapped.
+//
+// infile: the file to map
+// length: where to store the length of the mapping
+// offset: where to store the offset of the file's position in the mapping
+static char *map_file(FILE *infile, size_t *length, size_t *offset) {
+    struct stat st;
+    int fd = fileno(infile);
+    if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        return NULL;
+    }
+    long position = ftell(infile);
+    if (position < 0 || position >= st.st_size) {
+        return NULL;
+    }
+    char *map = (char *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    *length = st.st_size;
+    *offset = position;
+    return map;
+}
+
+// Allocates an empty text.
+// Returns: a pointer to the text, or NULL on failure.
+//
+// sketched: whether to count approximately in a sketch instead of a hash table
+static Text *text_alloc(bool sketched) {
+    Text *text = (Text *) calloc(1, sizeof(Text));
+    if (text == NULL) {
+        fprintf(stderr, "Could not allocate memory for text.\n");
+        return NULL;
+    }
+    if (sketched) {
+        text->sketch = sketch_create(sketch_width, sketch_depth, sketch_heavy);
+    } else if (text_fingerprints) {
+        text->ft = ft_create(FT_MIN_SLOTS, text_verify);
+    } else {
+        text->ht = ht_create(hash_table_size);
+        text->bf = bf_create(bloom_filter_size);
+    }
+    if (text->sketch == NULL && text->ft == NULL && (text->ht == NULL || text->bf == NULL)) {
+        fprintf(stderr, "Could not allocate memory for text.\n");
+        text_delete(&text);
+        return NULL;
+    }
+    return text;
+}
+
+// Counts the words of an in-memory buffer into a text,
+// splitting it across threads if it is large enough.
+// Returns: the number of words counted.
+//
+// text: the text to count into
+// start: the start of the buffer
+// end: the end of the buffer
+// noise: the noise words to ignore
+static uint64_t ingest(Text *text, char *start, char *end, NoiseSet *noise) {
+    uint64_t n = (end - start) / PARALLEL_CHUNK;
+    n = n < text_threads ? n : text_threads;
+    // sketches are not merged, and bigrams span the cuts, so count them in one pass
+    if (n > 1 && text->sketch == NULL && !featured(text)) {
+        return ingest_parallel(text, start, end, noise, n);
+    }
+    return ingest_buffer(text, start, end, noise);
+}
+
+// Records the size of a text and its structures, now that it is complete.
+//
+// text: the text
+static void account(Text *text) {
+    stats_memory(MEM_TEXT, text_bytes(text));
+    if (text->ht != NULL) {
+        stats_memory(MEM_HASH_TABLE, ht_bytes(text->ht));
+    }
+    if (text->bf != NULL) {
+        stats_memory(MEM_BLOOM_FILTER, bf_bytes(text->bf));
+    }
+    if (text->sketch != NULL) {
+        stats_memory(MEM_SKETCH, sketch_bytes(text->sketch));
+    }
+    if (text->ft != NULL) {
+        stats_memory(MEM_FINGERPRINTS, ft_bytes(text->ft));
+    }
+    return;
+}
+
+// Counts the words of a file into a text.
+// Regular files are mapped into memory and scanned directly, and split
+// across threads if they are large enough; anything else is parsed as a stream.
+// Returns: the text, or NULL on failure.
+//
+// text: the empty text to count into
+// infile: the file to read from
+// noise: the noise words to ignore
+static Text *text_fill(Text *text, FILE *infile, NoiseSet *noise) {
+    if (text == NULL) {
+        return NULL;
+    }
+    size_t length, offset;
+    char *map = map_file(infile, &length, &offset);
+    if (map == NULL) {
+        text->word_count = ingest_stream(text, infile, noise);
+    } else {
+        text->word_count = ingest(text, map + offset, map + length, noise);
+        munmap(map, length);
+        fseek(infile, 0, SEEK_END); // the whole file has been read
+    }
+    stats_count(WORDS, text->word_count);
+    account(text);
+    return text;
+}
+
 // Creates a text from the given file, filtering out the given noise.
 // Returns: a pointer to the created text.
 //
 // infile: the file to read from
-// noise: the noise to ignore
-Text *text_create(FILE *infile, Text *noise) {
-    Text *text = (Text *) malloc(sizeof(Text));
-    text->ht = ht_create(hash_table_size);
-    text->bf = bf_create(bloom_filter_size);
-    text->word_count = 0;
-    if (text->ht == NULL || text->bf == NULL) {
-        fprintf(stderr, "Could not allocate memory for text.\n");
-        free(text);
+// noise: the noise words to ignore, or NULL to keep every word
+Text *text_create(FILE *infile, NoiseSet *noise) {
+    return text_fill(text_alloc(false), infile, noise);
+}
+
+// Creates a text from the given file that only keeps approximate counts,
+// in memory fixed by sketch_width, sketch_depth and sketch_heavy
+// whatever the size of the file. Only its most frequent words can be listed.
+// Returns: a pointer to the created text.
+//
+// infile: the file to read from
+// noise: the noise words to ignore, or NULL to keep every word
+Text *text_create_sketch(FILE *infile, NoiseSet *noise) {
+    return text_fill(text_alloc(true), infile, noise);
+}
+
+// Creates a text from the contents of a file that are already in memory.
+// Returns: a pointer to the created text.
+//
+// data: the contents
+// length: the number of bytes of contents
+// noise: the noise words to ignore, or NULL to keep every word
+Text *text_create_buffer(char *data, size_t length, NoiseSet *noise) {
+    return text_fill_buffer(text_alloc(false), data, length, noise);
+}
+
+// Creates an empty text, to be filled with text_fill_buffer and emptied with
+// text_reset again and again, so one text serves a whole run of files.
+// Returns: a pointer to the text, or NULL on failure.
+Text *text_create_scratch(void) {
+    return text_alloc(false);
+}
+
+// Counts the contents of a file that are already in memory into an empty text.
+// Returns: the text, or NULL on failure.
+//
+// text: the empty or reset text to count into
+// data: the contents
+// length: the number of bytes of contents
+// noise: the noise words to ignore, or NULL to keep every word
+Text *text_fill_buffer(Text *text, char *data, size_t length, NoiseSet *noise) {
+    if (text == NULL) {
         return NULL;
     }
-    // adapted from assignment
-    regex_t regex;
-    if (regcomp(&regex, REGEX, REG_EXTENDED)) {
-        fprintf(stderr, "Regex could not compile.\n");
-        free(text);
+    text->word_count = ingest(text, data, data + length, noise);
+    stats_count(WORDS, text->word_count);
+    account(text);
+    return text;
+}
+
+// Empties a text so it can be filled again, keeping all of its memory:
+// only the used slots of its table are cleared, and the nodes are reused.
+//
+// text: the text to empty, made by text_create_scratch
+void text_reset(Text *text) {
+    if (text->ht != NULL) {
+        ht_clear(text->ht);
+    }
+    if (text->bf != NULL) {
+        bf_clear(text->bf);
+    }
+    if (text->ft != NULL) {
+        ft_clear(text->ft);
+    }
+    text->word_count = text->bigram_count = text->gram_count = text->last = 0;
+    return;
+}
+
+// Freezes a text counted by fingerprints into a profile, with the fingerprints
+// replaced by vocabulary ids.
+// Returns: the profile, or NULL on failure.
+//
+// text: the text to freeze, with a fingerprint table of words only
+// vocab: the vocabulary to take ids from, new fingerprints are added to it
+static Profile *fingerprint_profile(Text *text, Vocab *vocab) {
+    Profile *p = profile_create(ft_count(text->ft));
+    if (p == NULL) {
         return NULL;
     }
+    uint64_t key;
+    uint32_t count, n = 0;
+    for (uint32_t i = 0; i < ft_size(text->ft); i++) {
+        if (!ft_slot(text->ft, i, &key, &count)) {
+            continue;
+        }
+        p->terms[n].id = vocab_key(vocab, key);
+        p->terms[n].freq = count / (double) text->word_count;
+        if (p->terms[n++].id == VOCAB_NONE) {
+            profile_delete(&p);
+            return NULL;
+        }
+    }
+    profile_sort(p);
+    return p;
+}
 
-    char *word;
-    while ((word = next_word(infile, &regex)) != NULL) {
-        for (char *c = word; *c != '\0'; c++) {
-            *c = tolower(*c);
+// Freezes the text into a profile of word frequencies, with words replaced by vocabulary ids.
+// Texts counted by fingerprints keep their fingerprints, so their profiles only compare
+// with others counted the same way.
+// Returns: the profile, or NULL on failure or if the text is sketched or counts more
+// than words.
+//
+// text: the text to freeze
+// vocab: the vocabulary to take ids from, new words are added to it
+Profile *text_profile(Text *text, Vocab *vocab) {
+    if (text->ft != NULL) {
+        return featured(text) ? NULL : fingerprint_profile(text, vocab);
+    }
+    if (text->ht == NULL) {
+        return NULL;
+    }
+    Profile *p = profile_create(ht_count(text->ht));
+    if (p == NULL) {
+        return NULL;
+    }
+    HashTableIterator *hti = hti_create(text->ht);
+    Node *n;
+    for (uint32_t i = 0; (n = ht_iter(hti)) != NULL; i++) {
+        p->terms[i].id = vocab_id(vocab, n->word);
+        p->terms[i].freq = n->count / (double) text->word_count;
+        if (p->terms[i].id == VOCAB_NONE) {
+            hti_delete(&hti);
+            profile_delete(&p);
+            return NULL;
         }
-        // checks for NULL too, don't need to check that noise == NULL
-        if (text_contains(noise, word)) {
+    }
+    hti_delete(&hti);
+    profile_sort(p);
+    return p;
+}
+
+// Writes the text's word counts to a file, so it can be read back without
+// tokenizing the original again. The format is native-endian and only meant
+// to be read back on the same machine.
+// Returns: whether the whole text was written, never for texts without their words.
+//
+// text: the text to write
+// outfile: the file to write to
+bool text_write(Text *text, FILE *outfile) {
+    if (text->ht == NULL) {
+        return false;
+    }
+    uint32_t magic = TEXT_MAGIC, unique = ht_count(text->ht);
+    bool ok = fwrite(&magic, sizeof(magic), 1, outfile) == 1
+              && fwrite(&text->word_count, sizeof(text->word_count), 1, outfile) == 1
+              && fwrite(&unique, sizeof(unique), 1, outfile) == 1;
+    HashTableIterator *hti = hti_create(text->ht);
+    Node *n;
+    while (ok && (n = ht_iter(hti)) != NULL) {
+        uint16_t length = strlen(n->word);
+        ok = fwrite(&n->count, sizeof(n->count), 1, outfile) == 1
+             && fwrite(&length, sizeof(length), 1, outfile) == 1
+             && fwrite(n->word, 1, length, outfile) == length;
+    }
+    hti_delete(&hti);
+    return ok;
+}
+
+// Reads a text written by text_write.
+// Returns: the text, or NULL if the file is not a complete text,
+// or if n-gram features are counted, since they cannot be rebuilt from word counts.
+//
+// infile: the file to read from
+Text *text_read(FILE *infile) {
+    if (text_fingerprints && (text_bigrams || text_char_ngrams > 0)) {
+        return NULL;
+    }
+    uint32_t magic, unique;
+    uint64_t word_count;
+    if (fread(&magic, sizeof(magic), 1, infile) != 1 || magic != TEXT_MAGIC
+        || fread(&word_count, sizeof(word_count), 1, infile) != 1
+        || fread(&unique, sizeof(unique), 1, infile) != 1) {
+        return NULL;
+    }
+    Text *text = text_alloc(false);
+    if (text == NULL) {
+        return NULL;
+    }
+    text->word_count = word_count;
+    char word[MAX_WORD];
+    for (uint32_t i = 0; i < unique; i++) {
+        uint32_t count;
+        uint16_t length;
+        if (fread(&count, sizeof(count), 1, infile) != 1
+            || fread(&length, sizeof(length), 1, infile) != 1 || length >= MAX_WORD
+            || fread(word, 1, length, infile) != length) {
+            text_delete(&text);
+            return NULL;
+        }
+        word[length] = '\0';
+        if (text->ft != NULL) {
+            if (!ft_add(text->ft, word, count)) {
+                text_delete(&text);
+                return NULL;
+            }
             continue;
         }
-        if (!ht_insert(text->ht, word)) {
-            fprintf(stderr, "Hash table is full\n");
-            break;
+        Node *n = ht_insert(text->ht, word);
+        if (n == NULL) {
+            text_delete(&text);
+            return NULL;
         }
+        n->count = count;
         bf_insert(text->bf, word);
-        text->word_count++;
-        // if we're creating noise and we reached the limit
-        if (noise == NULL && text->word_count >= noiselimit) {
-            break;
-        }
     }
-    regfree(&regex);
+    account(text);
     return text;
 }
 
@@ -75,29 +683,93 @@ Text *text_create(FILE *infile, Text *noise) {
 //
 // text: a pointer to the address of the text to delete
 void text_delete(Text **text) {
-    ht_delete(&(*text)->ht);
-    bf_delete(&(*text)->bf);
+    if ((*text)->ht != NULL) {
+        ht_delete(&(*text)->ht);
+    }
+    if ((*text)->bf != NULL) {
+        bf_delete(&(*text)->bf);
+    }
+    if ((*text)->sketch != NULL) {
+        sketch_delete(&(*text)->sketch);
+    }
+    if ((*text)->ft != NULL) {
+        ft_delete(&(*text)->ft);
+    }
     free(*text);
     *text = NULL;
     return;
 }
 
-// Calculates the distance between two words' frequencies.
-// Returns: the distance, depending on the metric used.
+// Adds the distance of each word listed by one text to a running total.
+// For a sketched text, only its heavy hitters are listed.
 //
-// f1: the first value
-// f2: the second value
-// metric: the distance algorithm to use for calculations
-static double freq_dist(double f1, double f2, Metric metric) {
-    switch (metric) {
-    case MANHATTAN: return fabs(f1 - f2);
-    case EUCLIDEAN: return pow(f1 - f2, 2);
-    case COSINE: return f1 * f2;
-    default: fprintf(stderr, "Unknown Metric used.\n"); return 0;
+// total: the running total
+// text: the text whose words to list
+// other: the other text
+// first: whether text is the first text, otherwise words listed by the first are skipped
+// metric: the algorithm to use for the calculations
+static void add_dists(double *total, Text *text, Text *other, bool first, Metric metric) {
+    bool exact = text->sketch == NULL;
+    uint32_t heavy = exact ? 0 : sketch_heavy_count(text->sketch);
+    uint32_t slot = 0; // ht_next instead of an iterator, which would be allocated on every call
+    Node *n = NULL;
+    for (uint32_t i = 0;; i++) {
+        char *word;
+        if (exact) {
+            if ((n = ht_next(text->ht, &slot)) == NULL) {
+                break;
+            }
+            word = n->word;
+        } else if (i < heavy) {
+            word = sketch_heavy_word(text->sketch, i);
+        } else {
+            break;
+        }
+        // the word came from text itself, so it is known to be there
+        double own = exact ? n->count / (double) text->word_count
+                           : text_frequency_known(text, word);
+        if (first) {
+            *total += freq_dist(own, text_frequency(other, word), metric);
+        } else if (!text_contains(other, word)) { // ignore duplicates
+            // an exact first text does not have the word, but a sketch may still count it
+            double f1 = other->sketch == NULL ? 0 : text_frequency(other, word);
+            *total += freq_dist(f1, own, metric);
+        }
+    }
+    return;
+}
+
+// Adds the distance of each fingerprint of one text to a running total.
+// Each kind of feature is a frequency distribution of its own, so the vector
+// compared is the words' frequencies followed by those of each kind of n-gram.
+//
+// total: the running total
+// text: the text whose fingerprints to go through
+// other: the other text
+// first: whether text is the first text, otherwise fingerprints of the first are skipped
+// metric: the algorithm to use for the calculations
+static void add_fingerprint_dists(
+    double *total, Text *text, Text *other, bool first, Metric metric) {
+    uint64_t key;
+    uint32_t count;
+    for (uint32_t i = 0; i < ft_size(text->ft); i++) {
+        if (!ft_slot(text->ft, i, &key, &count)) {
+            continue;
+        }
+        uint32_t other_count = ft_lookup(other->ft, key);
+        if (first) {
+            double f1 = count / (double) kind_count(text, key);
+            double f2 = other_count == 0 ? 0 : other_count / (double) kind_count(other, key);
+            *total += freq_dist(f1, f2, metric);
+        } else if (other_count == 0) { // ignore duplicates
+            *total += freq_dist(0, count / (double) kind_count(text, key), metric);
+        }
     }
+    return;
 }
 
 // Returns the "distance" between two computed vectors, composed of the words in the texts.
+// Texts keyed by fingerprints can only be compared with each other.
 //
 // text1: the first text to read the words from
 // text2: the second text to read the words from
@@ -105,26 +777,18 @@ static double freq_dist(double f1, double f2, Metric metric) {
 double text_dist(Text *text1, Text *text2, Metric metric) {
     double total = 0;
 
-    // loop over all words for text1
-    HashTableIterator *hti1 = hti_create(text1->ht);
-    Node *n;
-    while ((n = ht_iter(hti1)) != NULL) {
-        double f1 = text_frequency(text1, n->word);
-        double f2 = text_frequency(text2, n->word);
-        total += freq_dist(f1, f2, metric);
-    }
-    hti_delete(&hti1);
-    // loop over text2, but ignore words already done in 1
-    HashTableIterator *hti2 = hti_create(text2->ht);
-    while ((n = ht_iter(hti2)) != NULL) {
-        // ignore duplicates
-        if (text_contains(text1, n->word)) {
-            continue;
-        }
-        double f2 = text_frequency(text2, n->word);
-        total += freq_dist(0, f2, metric); // we know the word is not in text1
+    if (text1->ft != NULL && text2->ft != NULL) {
+        add_fingerprint_dists(&total, text1, text2, true, metric);
+        add_fingerprint_dists(&total, text2, text1, false, metric);
+    } else if (text1->ft != NULL || text2->ft != NULL) {
+        fprintf(stderr, "Texts keyed by fingerprints can only be compared with each other.\n");
+        return -1;
+    } else {
+        // loop over all words for text1
+        add_dists(&total, text1, text2, true, metric);
+        // loop over text2, but ignore words already done in 1
+        add_dists(&total, text2, text1, false, metric);
     }
-    hti_delete(&hti2);
 
     // now apply appropriate steps
     switch (metric) {
@@ -135,20 +799,149 @@ double text_dist(Text *text1, Text *text2, Metric metric) {
     }
 }
 
+// Returns the number of distinct words a text lists.
+//
+// text: the text
+static uint32_t text_unique(Text *text) {
+    if (text->sketch != NULL) {
+        return sketch_heavy_count(text->sketch);
+    }
+    return text->ft != NULL ? ft_count(text->ft) : ht_count(text->ht);
+}
+
+// Bounds how far text_dist may be off because of one sketched text.
+// Every word the distance sums over is listed by one of the texts, so there are at
+// most m of them, and each estimate is at most epsilon too high. Words the
+// sketch counted but cannot list make up at most its tail of the frequencies,
+// and are summed as if the sketch did not have them.
+// Returns: the bound.
+//
+// sketched: the sketched text
+// other: the other text
+// metric: the metric of the distance
+static double sketch_error(Text *sketched, Text *other, Metric metric) {
+    Sketch *sk = sketched->sketch;
+    double m = sketch_heavy_count(sk) + text_unique(other);
+    double epsilon = sketch_epsilon(sk), tail = sketch_tail(sk);
+    switch (metric) {
+    case MANHATTAN: return m * epsilon + tail;
+    case EUCLIDEAN: return sqrt(m) * epsilon + tail;
+    case COSINE: return epsilon; // the frequencies of the other text add up to 1
+    default: fprintf(stderr, "Unknown Metric used.\n"); return 0;
+    }
+}
+
+// Bounds how far text_dist may be from the exact distance when either text is sketched.
+// The bound holds as long as every estimate of the sketches does, which each one
+// fails to with probability at most sketch_delta.
+// Returns: the bound, 0 if neither text is sketched.
+//
+// text1: the first text
+// text2: the second text
+// metric: the metric of the distance
+double text_error(Text *text1, Text *text2, Metric metric) {
+    double error = 0;
+    if (text1->sketch != NULL) {
+        error += sketch_error(text1, text2, metric);
+    }
+    if (text2->sketch != NULL) {
+        error += sketch_error(text2, text1, metric);
+    }
+    return error;
+}
+
+// Returns the probability that a single estimate of the text is off by more than
+// the error text_error allows for, 0 if the text is exact.
+//
+// text: the text
+double text_delta(Text *text) {
+    return text->sketch == NULL ? 0 : sketch_delta(text->sketch);
+}
+
+// Looks a word up in a text's hash table, probing its Bloom filter first
+// unless the call site has measured that the filter does not pay off.
+// Returns: the word's node, or NULL if the text does not have it.
+//
+// text: the text, with a hash table
+// word: the word to look for
+// site: where the lookup comes from
+static Node *lookup(Text *text, char *word, Site site) {
+    SiteStats *s = &sites[site];
+    bool sampled = s->lookups % SITE_SAMPLE == 0;
+    uint64_t start = sampled ? stats_now() : 0;
+    bool maybe = true;
+    if (!s->bypass || sampled) { // a sample times the filter even while it is bypassed
+        stats_count(BF_LOOKUPS, 1);
+        maybe = bf_probe(text->bf, word);
+        if (sampled) {
+            uint64_t now = stats_now();
+            sample(&s->filter_ns, now - start);
+            start = now;
+        }
+    } else {
+        stats_count(BF_BYPASSES, 1);
+    }
+    Node *n = NULL;
+    if (maybe) {
+        n = ht_lookup(text->ht, word);
+        if (sampled) {
+            sample(&s->lookup_ns, stats_now() - start);
+        }
+        if (n == NULL && (!s->bypass || sampled)) { // BF told us it's there, but it's not
+            stats_count(BF_FALSE_POSITIVES, 1);
+        }
+    }
+    if (n == NULL) {
+        s->misses++;
+    }
+    // rejections end windows too, or one at the end of a window would skip past it
+    if (++s->lookups == SITE_WINDOW) {
+        // until both costs have been measured, the comparison would be against a 0
+        s->bypass = s->lookup_ns > 0 && s->filter_ns > 0
+                    && s->misses * s->lookup_ns < s->lookups * s->filter_ns;
+        s->lookups = 0;
+        s->misses = 0;
+    }
+    return n;
+}
+
 // Calculates the normalized frequency of a word in a text.
 // Returns: the normalized frequency.
 //
 // text: the text to find the occurrences of the word in
 // word: the word to look for
 double text_frequency(Text *text, char *word) {
-    if (!text_contains(text, word)) {
+    if (text != NULL && text->sketch != NULL) {
+        uint64_t estimate = sketch_estimate(text->sketch, word);
+        return text->word_count == 0 ? 0 : estimate / (double) text->word_count;
+    }
+    if (text != NULL && text->ft != NULL) {
+        uint32_t count = ft_lookup(text->ft, ft_fingerprint(word));
+        return count == 0 ? 0 : count / (double) text->word_count;
+    }
+    if (text == NULL) {
         return 0;
     }
+    Node *n = lookup(text, word, SITE_FREQUENCY);
+    return n == NULL ? 0 : n->count / (double) text->word_count;
+}
+
+// Calculates the normalized frequency of a word the caller knows the text has,
+// such as one listed from the text itself, without probing its Bloom filter.
+// Returns: the normalized frequency, 0 if the text does not have the word after all.
+//
+// text: the text to find the occurrences of the word in
+// word: the word to look for
+double text_frequency_known(Text *text, char *word) {
+    if (text->ht == NULL) {
+        return text_frequency(text, word);
+    }
     Node *n = ht_lookup(text->ht, word);
     return n == NULL ? 0 : n->count / (double) text->word_count;
 }
 
 // Returns whether or not the text contains the given word.
+// A sketched text only answers for its heavy hitters.
 //
 // text: the text to check
 // word: the word to look for
@@ -156,22 +949,82 @@ bool text_contains(Text *text, char *word) {
     if (text == NULL) {
         return false;
     }
-    bf_lookups++;
-    if (!bf_probe(text->bf, word)) {
-        return false;
+    if (text->sketch != NULL) {
+        return sketch_heavy_contains(text->sketch, word);
+    }
+    if (text->ft != NULL) {
+        return ft_lookup(text->ft, ft_fingerprint(word)) > 0;
+    }
+    return lookup(text, word, SITE_CONTAINS) != NULL;
+}
+
+// Returns the number of bytes the text takes, with all of its structures.
+//
+// text: the text
+uint64_t text_bytes(Text *text) {
+    uint64_t bytes = sizeof(Text);
+    if (text->ht != NULL) {
+        bytes += ht_bytes(text->ht);
+    }
+    if (text->bf != NULL) {
+        bytes += bf_bytes(text->bf);
+    }
+    if (text->sketch != NULL) {
+        bytes += sketch_bytes(text->sketch);
     }
-    bool contains = ht_lookup(text->ht, word) != NULL;
-    // BF told us it's there, but it's not
-    if (!contains) {
-        bf_false_positives++;
+    if (text->ft != NULL) {
+        bytes += ft_bytes(text->ft);
     }
-    return contains;
+    return bytes;
+}
+
+// Returns the number of bytes an exact text takes before it has counted any word,
+// which is most of a small text: its tables are sized by hash_table_size and
+// bloom_filter_size rather than by its contents.
+uint64_t text_base_bytes(void) {
+    uint64_t slots = hash_table_size;
+    if (text_fingerprints) {
+        uint64_t slot = sizeof(uint64_t) + sizeof(uint32_t) + (text_verify ? sizeof(char *) : 0);
+        return sizeof(Text) + slots * slot;
+    }
+    return sizeof(Text) + slots * sizeof(Node *) + bloom_filter_size / 8;
+}
+
+// Returns the fraction of the text's hash table slots that are in use.
+//
+// text: the text to get the load of
+double text_load(Text *text) {
+    if (text->sketch != NULL) {
+        return 0;
+    }
+    if (text->ft != NULL) {
+        return ft_count(text->ft) / (double) ft_size(text->ft);
+    }
+    return ht_count(text->ht) / (double) ht_size(text->ht);
+}
+
+// Returns the longest run of used slots in the text's hash table.
+//
+// text: the text to scan
+uint32_t text_longest_run(Text *text) {
+    if (text->ht == NULL) {
+        return 0;
+    }
+    return ht_longest_run(text->ht);
 }
 
 // Debug function to print the text.
 //
 // text: the text to print
 void text_print(Text *text) {
+    if (text->sketch != NULL) {
+        sketch_print(text->sketch);
+        return;
+    }
+    if (text->ft != NULL) {
+        ft_print(text->ft);
+        return;
+    }
     bf_print(text->bf);
     ht_print(text->ht);
     return;
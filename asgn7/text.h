@@ -1,22 +1,54 @@
 #pragma once
 #include "metric.h"
+#include "ns.h"
+#include "profile.h"
+#include "vocab.h"
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 
-extern uint32_t noiselimit; // Number of noise words to filter out.
-
 typedef struct Text Text;
 
-Text *text_create(FILE *infile, Text *noise);
+Text *text_create(FILE *infile, NoiseSet *noise);
+
+Text *text_create_sketch(FILE *infile, NoiseSet *noise);
+
+Text *text_create_buffer(char *data, size_t length, NoiseSet *noise);
+
+Text *text_create_scratch(void);
+
+Text *text_fill_buffer(Text *text, char *data, size_t length, NoiseSet *noise);
+
+void text_reset(Text *text);
+
+Profile *text_profile(Text *text, Vocab *vocab);
+
+bool text_write(Text *text, FILE *outfile);
+
+Text *text_read(FILE *infile);
 
 void text_delete(Text **text);
 
 double text_dist(Text *text1, Text *text2, Metric metric);
 
+double text_error(Text *text1, Text *text2, Metric metric);
+
+double text_delta(Text *text);
+
 double text_frequency(Text *text, char *word);
 
+double text_frequency_known(Text *text, char *word);
+
 bool text_contains(Text *text, char *word);
 
+uint64_t text_bytes(Text *text);
+
+uint64_t text_base_bytes(void);
+
+double text_load(Text *text);
+
+uint32_t text_longest_run(Text *text);
+
 void text_print(Text *text);
@@ -0,0 +1,182 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fnv.h"
+#include "vocab.h"
+
+#define MIN_SLOTS 1024
+
+// Gives every distinct word a small integer id, in the order they are first seen,
+// so that profiles can store and compare ids instead of strings.
+struct Vocab {
+    uint32_t size; // number of words
+    uint32_t capacity; // length of words and hashes
+    char **words; // id -> word
+    uint64_t *hashes; // id -> hash of the word
+    uint32_t mask; // number of slots - 1, a power of 2 minus 1
+    uint32_t *slots; // id + 1 of the word in each slot, 0 if empty
+};
+
+// Creates an empty vocabulary.
+// Returns: a pointer to the vocabulary, or NULL on failure.
+Vocab *vocab_create(void) {
+    Vocab *v = (Vocab *) malloc(sizeof(Vocab));
+    if (v == NULL) {
+        return NULL;
+    }
+    v->size = 0;
+    v->capacity = MIN_SLOTS / 2;
+    v->words = (char **) malloc(v->capacity * sizeof(char *));
+    v->hashes = (uint64_t *) malloc(v->capacity * sizeof(uint64_t));
+    v->mask = MIN_SLOTS - 1;
+    v->slots = (uint32_t *) calloc(MIN_SLOTS, sizeof(uint32_t));
+    if (v->words == NULL || v->hashes == NULL || v->slots == NULL) {
+        free(v->words);
+        free(v->hashes);
+        free(v->slots);
+        free(v);
+        return NULL;
+    }
+    return v;
+}
+
+// Deletes the vocabulary.
+//
+// v: a pointer to the address of the vocabulary
+void vocab_delete(Vocab **v) {
+    for (uint32_t i = 0; i < (*v)->size; i++) {
+        free((*v)->words[i]);
+    }
+    free((*v)->words);
+    free((*v)->hashes);
+    free((*v)->slots);
+    free(*v);
+    *v = NULL;
+    return;
+}
+
+// Returns the number of words in the vocabulary.
+//
+// v: the vocabulary
+uint32_t vocab_size(Vocab *v) {
+    return v->size;
+}
+
+// Finds the slot for a word, either the one holding it or the first empty one.
+// Returns: the index of the slot.
+//
+// v: the vocabulary
+// word: the word to look for, or NULL for a fingerprint, which only has its hash
+// h: the hash of the word, or the fingerprint
+static uint32_t find_slot(Vocab *v, char *word, uint64_t h) {
+    uint32_t i = h & v->mask;
+    while (v->slots[i] != 0) {
+        uint32_t id = v->slots[i] - 1;
+        if (v->hashes[id] == h
+            && (word == NULL ? v->words[id] == NULL
+                             : v->words[id] != NULL && strcmp(v->words[id], word) == 0)) {
+            break;
+        }
+        i = (i + 1) & v->mask;
+    }
+    return i;
+}
+
+// Doubles the vocabulary's storage.
+// Returns: whether it could be grown.
+//
+// v: the vocabulary
+static bool grow(Vocab *v) {
+    uint32_t capacity = 2 * v->capacity;
+    char **words = (char **) realloc(v->words, capacity * sizeof(char *));
+    if (words == NULL) {
+        return false;
+    }
+    v->words = words;
+    uint64_t *hashes = (uint64_t *) realloc(v->hashes, capacity * sizeof(uint64_t));
+    if (hashes == NULL) {
+        return false;
+    }
+    v->hashes = hashes;
+    uint32_t *slots = (uint32_t *) calloc(2 * capacity, sizeof(uint32_t));
+    if (slots == NULL) {
+        return false;
+    }
+    free(v->slots);
+    v->slots = slots;
+    v->mask = 2 * capacity - 1;
+    v->capacity = capacity;
+    for (uint32_t id = 0; id < v->size; id++) {
+        uint32_t i = v->hashes[id] & v->mask;
+        while (v->slots[i] != 0) {
+            i = (i + 1) & v->mask;
+        }
+        v->slots[i] = id + 1;
+    }
+    return true;
+}
+
+// Returns the id of a word or fingerprint, adding it if it is new.
+// Returns: the id, or VOCAB_NONE if it could not be added.
+//
+// v: the vocabulary
+// word: the word to look up, or NULL for a fingerprint
+// h: the hash of the word, or the fingerprint
+static uint32_t lookup_or_add(Vocab *v, char *word, uint64_t h) {
+    uint32_t i = find_slot(v, word, h);
+    if (v->slots[i] != 0) {
+        return v->slots[i] - 1;
+    }
+    if (v->size == v->capacity) { // keeps the slots at most half full
+        if (!grow(v)) {
+            return VOCAB_NONE;
+        }
+        i = find_slot(v, word, h);
+    }
+    char *copy = word != NULL ? strdup(word) : NULL;
+    if (word != NULL && copy == NULL) {
+        return VOCAB_NONE;
+    }
+    v->words[v->size] = copy;
+    v->hashes[v->size] = h;
+    v->slots[i] = ++v->size;
+    return v->size - 1;
+}
+
+// Returns the id of the word, adding it if it is new.
+// Returns: the id, or VOCAB_NONE if it could not be added.
+//
+// v: the vocabulary
+// word: the word to look up
+uint32_t vocab_id(Vocab *v, char *word) {
+    return lookup_or_add(v, word, fnv1a(word));
+}
+
+// Returns the id of a word counted by its fingerprint, adding it if it is new.
+// Fingerprints and words get ids of their own, even for the same word.
+// Returns: the id, or VOCAB_NONE if it could not be added.
+//
+// v: the vocabulary
+// key: the fingerprint of the word, from ft_fingerprint
+uint32_t vocab_key(Vocab *v, uint64_t key) {
+    return lookup_or_add(v, NULL, key);
+}
+
+// Returns the id of the word without adding it.
+// Returns: the id, or VOCAB_NONE if the word is not in the vocabulary.
+//
+// v: the vocabulary
+// word: the word to look up
+uint32_t vocab_find(Vocab *v, char *word) {
+    uint32_t i = find_slot(v, word, fnv1a(word));
+    return v->slots[i] == 0 ? VOCAB_NONE : v->slots[i] - 1;
+}
+
+// Returns the word with the given id, NULL if it was added by its fingerprint.
+//
+// v: the vocabulary
+// id: the id of the word
+char *vocab_word(Vocab *v, uint32_t id) {
+    return v->words[id];
+}
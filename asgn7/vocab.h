@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+
+#define VOCAB_NONE UINT32_MAX
+
+typedef struct Vocab Vocab;
+
+Vocab *vocab_create(void);
+
+void vocab_delete(Vocab **v);
+
+uint32_t vocab_size(Vocab *v);
+
+uint32_t vocab_id(Vocab *v, char *word);
+
+uint32_t vocab_key(Vocab *v, uint64_t key);
+
+uint32_t vocab_find(Vocab *v, char *word);
+
+char *vocab_word(Vocab *v, uint32_t id);
@@ -0,0 +1,200 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "window.h"
+
+// One library text that has a word, and the word's frequency in it.
+typedef struct {
+    uint32_t text;
+    double freq;
+} Posting;
+
+// The last size words of a text, with its distance to every library text kept up to date
+// as words enter and leave. Only the texts that have a word are touched when its count
+// changes, and the rest of each distance is kept in closed form, so every word costs
+// O(1) for the window plus one update per library text that uses the word.
+struct Window {
+    Library *lib;
+    Metric metric;
+    uint32_t size;
+    uint32_t *ring; // the ids of the words in the window, oldest at pos once full
+    uint32_t pos;
+    uint32_t filled;
+    uint32_t *counts; // count in the window of every vocabulary id
+    uint32_t capacity; // length of counts
+    uint32_t *offsets; // postings of id are postings[offsets[id]] to postings[offsets[id + 1]]
+    Posting *postings;
+    uint32_t indexed; // number of ids with postings, the vocabulary size of the library
+    uint64_t squares; // sum of the squared counts
+    double *dots; // sum over the text's words of count * freq
+    double *sums; // manhattan: sum over the text's words of |count / size - freq| - count / size
+    double *norms; // sum of the text's squared frequencies
+};
+
+// Creates an empty window over a library.
+// Returns: the window, or NULL on failure.
+//
+// lib: the library to compare against, its vocabulary grows with the words pushed
+// size: the number of words in the window
+// metric: the distance to keep up to date
+Window *window_create(Library *lib, uint32_t size, Metric metric) {
+    Window *w = (Window *) calloc(1, sizeof(Window));
+    if (w == NULL) {
+        return NULL;
+    }
+    w->lib = lib;
+    w->metric = metric;
+    w->size = size > 0 ? size : 1;
+    w->indexed = vocab_size(lib->vocab);
+    w->capacity = w->indexed > 0 ? w->indexed : 1;
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < lib->count; i++) {
+        total += lib->profiles[i]->size;
+    }
+    w->ring = (uint32_t *) malloc(w->size * sizeof(uint32_t));
+    w->counts = (uint32_t *) calloc(w->capacity, sizeof(uint32_t));
+    w->offsets = (uint32_t *) calloc(w->indexed + 1, sizeof(uint32_t));
+    w->postings = (Posting *) malloc((total > 0 ? total : 1) * sizeof(Posting));
+    w->dots = (double *) calloc(lib->count + 1, sizeof(double));
+    w->sums = (double *) calloc(lib->count + 1, sizeof(double));
+    w->norms = (double *) calloc(lib->count + 1, sizeof(double));
+    if (w->ring == NULL || w->counts == NULL || w->offsets == NULL || w->postings == NULL
+        || w->dots == NULL || w->sums == NULL || w->norms == NULL) {
+        window_delete(&w);
+        return NULL;
+    }
+    // invert the profiles: count the postings of every id, then fill them in
+    for (uint32_t i = 0; i < lib->count; i++) {
+        for (uint32_t j = 0; j < lib->profiles[i]->size; j++) {
+            w->offsets[lib->profiles[i]->terms[j].id + 1]++;
+        }
+    }
+    for (uint32_t id = 0; id < w->indexed; id++) {
+        w->offsets[id + 1] += w->offsets[id];
+    }
+    uint32_t *next = w->counts; // borrowed as the fill position of every id, zeroed after
+    for (uint32_t i = 0; i < lib->count; i++) {
+        Profile *p = lib->profiles[i];
+        for (uint32_t j = 0; j < p->size; j++) {
+            uint32_t id = p->terms[j].id;
+            w->postings[w->offsets[id] + next[id]++] = (Posting) { i, p->terms[j].freq };
+            // with an empty window, every word of the text is |0 - freq| away
+            w->sums[i] += p->terms[j].freq;
+            w->norms[i] += p->terms[j].freq * p->terms[j].freq;
+        }
+    }
+    memset(w->counts, 0, w->capacity * sizeof(uint32_t));
+    return w;
+}
+
+// Deletes the window.
+//
+// w: a pointer to the address of the window
+void window_delete(Window **w) {
+    free((*w)->ring);
+    free((*w)->counts);
+    free((*w)->offsets);
+    free((*w)->postings);
+    free((*w)->dots);
+    free((*w)->sums);
+    free((*w)->norms);
+    free(*w);
+    *w = NULL;
+    return;
+}
+
+// Changes the count of a word in the window by one.
+//
+// w: the window
+// id: the vocabulary id of the word
+// delta: 1 or -1
+static void update(Window *w, uint32_t id, int delta) {
+    uint32_t c = w->counts[id], c2 = c + delta;
+    w->counts[id] = c2;
+    w->squares += (uint64_t) c2 * c2 - (uint64_t) c * c;
+    if (id >= w->indexed) { // no library text has it
+        return;
+    }
+    double before = c / (double) w->size, after = c2 / (double) w->size;
+    for (uint32_t k = w->offsets[id]; k < w->offsets[id + 1]; k++) {
+        Posting *p = &w->postings[k];
+        w->dots[p->text] += delta * p->freq;
+        w->sums[p->text] += (fabs(after - p->freq) - after) - (fabs(before - p->freq) - before);
+    }
+    return;
+}
+
+// Pushes the next word of the text into the window, dropping the oldest once it is full.
+// Returns: whether the word could be added.
+//
+// w: the window
+// word: the word, already filtered for noise
+bool window_push(Window *w, char *word) {
+    uint32_t id = vocab_id(w->lib->vocab, word);
+    if (id == VOCAB_NONE) {
+        return false;
+    }
+    if (id >= w->capacity) {
+        uint32_t capacity = w->capacity * 2 > id ? w->capacity * 2 : id + 1;
+        uint32_t *counts = (uint32_t *) realloc(w->counts, capacity * sizeof(uint32_t));
+        if (counts == NULL) {
+            return false;
+        }
+        memset(counts + w->capacity, 0, (capacity - w->capacity) * sizeof(uint32_t));
+        w->counts = counts;
+        w->capacity = capacity;
+    }
+    if (w->filled == w->size) {
+        update(w, w->ring[w->pos], -1);
+    } else {
+        w->filled++;
+    }
+    update(w, id, 1);
+    w->ring[w->pos] = id;
+    w->pos = (w->pos + 1) % w->size;
+    return true;
+}
+
+// Returns whether the window holds as many words as it can.
+//
+// w: the window
+bool window_full(Window *w) {
+    return w->filled == w->size;
+}
+
+// Returns the distance between the full window and a library text,
+// the same as text_dist between the window's words and the text.
+//
+// w: the window
+// text: the index of the text in the library
+double window_dist(Window *w, uint32_t text) {
+    double n = w->size;
+    switch (w->metric) {
+    case MANHATTAN: return w->sums[text] + w->filled / n; // words the text lacks add count / size
+    case EUCLIDEAN: {
+        double total = w->squares / (n * n) + w->norms[text] - 2 * w->dots[text] / n;
+        return sqrt(total > 0 ? total : 0); // cancellation can leave a tiny negative
+    }
+    case COSINE: return 1 - w->dots[text] / n;
+    default: fprintf(stderr, "Unknown Metric used.\n"); return -1;
+    }
+}
+
+// Finds the library text closest to the full window.
+// Returns: the index of the text, or UINT32_MAX if the library is empty.
+//
+// w: the window
+// dist: where to store the distance to it
+uint32_t window_best(Window *w, double *dist) {
+    uint32_t best = UINT32_MAX;
+    for (uint32_t i = 0; i < w->lib->count; i++) {
+        double d = window_dist(w, i);
+        if (best == UINT32_MAX || d < *dist) {
+            best = i;
+            *dist = d;
+        }
+    }
+    return best;
+}
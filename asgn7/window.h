@@ -0,0 +1,21 @@
+#pragma once
+
+#include "library.h"
+#include "metric.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct Window Window;
+
+Window *window_create(Library *lib, uint32_t size, Metric metric);
+
+void window_delete(Window **w);
+
+bool window_push(Window *w, char *word);
+
+bool window_full(Window *w);
+
+double window_dist(Window *w, uint32_t text);
+
+uint32_t window_best(Window *w, double *dist);